@@ -61,23 +61,728 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
 #include <future>
 #include <immintrin.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
 #include <vector>
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 struct Keypoint {
 	int32_t x;
 	int32_t y;
 	uint8_t score;
 
+	Keypoint() = default;
 	Keypoint(const int32_t _x, const int32_t _y, const uint8_t _score) : x(_x), y(_y), score(_score) {}
 };
 
+// Compact keypoint for memory- and bandwidth-bound consumers, e.g. IPC:
+// 5 bytes instead of 12, for images up to 65535 pixels on a side.
+// Selected by detecting into a std::vector<KFASTCompactKeypoint>
+// (or a KFASTDetector<..., KFASTCompactKeypoint>), which KFAST fills directly.
+#pragma pack(push, 1)
+struct KFASTCompactKeypoint {
+	uint16_t x;
+	uint16_t y;
+	uint8_t score;
+
+	KFASTCompactKeypoint() = default;
+	KFASTCompactKeypoint(const int32_t _x, const int32_t _y, const uint8_t _score) :
+		x(static_cast<uint16_t>(_x)), y(static_cast<uint16_t>(_y)), score(_score) {
+		assert(_x >= 0 && _x <= 0xFFFF && _y >= 0 && _y <= 0xFFFF);
+	}
+};
+#pragma pack(pop)
+
+// Structure-of-arrays keypoints: x, y and score in separate 64-byte aligned
+// arrays, with no per-keypoint padding, for consumers that load only x or
+// only y into SIMD registers. Without non-max suppression, KFAST appends
+// whole 32-pixel corner masks at once with vector stores (see emplaceMask).
+class KFASTKeypointsSoA {
+public:
+	KFASTKeypointsSoA() = default;
+
+	KFASTKeypointsSoA(const KFASTKeypointsSoA& other) { append(other); }
+	KFASTKeypointsSoA& operator=(const KFASTKeypointsSoA& other) {
+		if (this != &other) {
+			clear();
+			append(other);
+		}
+		return *this;
+	}
+
+	KFASTKeypointsSoA(KFASTKeypointsSoA&& other) noexcept { swap(other); }
+	KFASTKeypointsSoA& operator=(KFASTKeypointsSoA&& other) noexcept {
+		swap(other);
+		return *this;
+	}
+
+	~KFASTKeypointsSoA() {
+		_mm_free(xs);
+		_mm_free(ys);
+		_mm_free(scores);
+	}
+
+	size_t size() const { return n; }
+	bool empty() const { return n == 0; }
+	void clear() { n = 0; }
+	void reserve(const size_t count) { if (count > cap) grow(count); }
+
+	const int32_t* x() const { return xs; }
+	const int32_t* y() const { return ys; }
+	const uint8_t* score() const { return scores; }
+	Keypoint operator[](const size_t k) const { return Keypoint(xs[k], ys[k], scores[k]); }
+
+	void emplace_back(const int32_t x, const int32_t y, const uint8_t score) {
+		if (n == cap) grow(n + 1);
+		xs[n] = x;
+		ys[n] = y;
+		scores[n] = score;
+		++n;
+	}
+
+	// Appends (x0 + b, y, 0) for each set bit b of 'mask', in order. Each byte
+	// of the mask is left-packed through a lookup table and written as 8 lanes
+	// at once; lanes past the last corner are overwritten by the next store.
+	void emplaceMask(uint32_t mask, const int32_t x0, const int32_t y) {
+		if (!mask) return;
+		if (n + 40 > cap) grow(n + 40);
+		const uint64_t* const pack = packTable();
+		const __m256i vy = _mm256_set1_epi32(y);
+		for (int32_t b = 0; mask; b += 8, mask >>= 8) {
+			const uint32_t bits = mask & 0xFF;
+			if (!bits) continue;
+			const __m256i lanes = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(static_cast<int64_t>(pack[bits])));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(xs + n), _mm256_add_epi32(lanes, _mm256_set1_epi32(x0 + b)));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(ys + n), vy);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(scores + n), _mm_setzero_si128());
+			n += _mm_popcnt_u32(bits);
+		}
+	}
+
+	void append(const KFASTKeypointsSoA& other) {
+		reserve(n + other.n);
+		if (other.n) {
+			memcpy(xs + n, other.xs, other.n * sizeof(int32_t));
+			memcpy(ys + n, other.ys, other.n * sizeof(int32_t));
+			memcpy(scores + n, other.scores, other.n);
+		}
+		n += other.n;
+	}
+
+private:
+	// byte k of entry 'bits' is the index of the k-th set bit of 'bits'
+	static const uint64_t* packTable() {
+		struct Table {
+			Table() {
+				for (uint32_t bits = 0; bits < 256; ++bits) {
+					uint64_t entry = 0;
+					int32_t k = 0;
+					for (uint32_t b = 0; b < 8; ++b) {
+						if (bits & (1u << b)) entry |= static_cast<uint64_t>(b) << (8 * k++);
+					}
+					entries[bits] = entry;
+				}
+			}
+			uint64_t entries[256];
+		};
+		static const Table table;
+		return table.entries;
+	}
+
+	void grow(const size_t count) {
+		const size_t new_cap = std::max(count, 2 * cap);
+		int32_t* const new_xs = static_cast<int32_t*>(_mm_malloc(new_cap * sizeof(int32_t), 64));
+		int32_t* const new_ys = static_cast<int32_t*>(_mm_malloc(new_cap * sizeof(int32_t), 64));
+		uint8_t* const new_scores = static_cast<uint8_t*>(_mm_malloc(new_cap, 64));
+		if (!new_xs || !new_ys || !new_scores) {
+			_mm_free(new_xs);
+			_mm_free(new_ys);
+			_mm_free(new_scores);
+			throw std::bad_alloc();
+		}
+		if (n) {
+			memcpy(new_xs, xs, n * sizeof(int32_t));
+			memcpy(new_ys, ys, n * sizeof(int32_t));
+			memcpy(new_scores, scores, n);
+		}
+		_mm_free(xs);
+		_mm_free(ys);
+		_mm_free(scores);
+		xs = new_xs;
+		ys = new_ys;
+		scores = new_scores;
+		cap = new_cap;
+	}
+
+	void swap(KFASTKeypointsSoA& other) {
+		std::swap(xs, other.xs);
+		std::swap(ys, other.ys);
+		std::swap(scores, other.scores);
+		std::swap(n, other.n);
+		std::swap(cap, other.cap);
+	}
+
+	int32_t* xs = nullptr;
+	int32_t* ys = nullptr;
+	uint8_t* scores = nullptr;
+	size_t n = 0;
+	size_t cap = 0;
+};
+
+// Row-indexed (CSR) keypoints: columns and scores in raster order, next to
+// a row-pointer array. After KFAST, rowPtr() has one entry per image row
+// plus one, and the keypoints in rows [a, b] are those with indices
+// [rowPtr()[a], rowPtr()[b + 1]), so range queries need no searching.
+class KFASTKeypointsCSR {
+public:
+	size_t size() const { return xs.size(); }
+	bool empty() const { return xs.empty(); }
+
+	void clear() {
+		xs.clear();
+		scores.clear();
+		row_ptr.clear();
+	}
+
+	void reserve(const size_t count) {
+		xs.reserve(count);
+		scores.reserve(count);
+	}
+
+	const int32_t* x() const { return xs.data(); }
+	const uint8_t* score() const { return scores.data(); }
+	const uint32_t* rowPtr() const { return row_ptr.data(); }
+
+	// number of rows indexed so far
+	int32_t rows() const { return row_ptr.empty() ? 0 : static_cast<int32_t>(row_ptr.size()) - 1; }
+
+	// keypoints must arrive in raster order
+	void emplace_back(const int32_t x, const int32_t y, const uint8_t score) {
+		while (static_cast<int32_t>(row_ptr.size()) <= y) row_ptr.push_back(static_cast<uint32_t>(xs.size()));
+		xs.push_back(x);
+		scores.push_back(score);
+	}
+
+	// Appends keypoints from rows below all of these. 'other' may be indexed
+	// from row 0 (with empty rows up to its first keypoint), as bands are.
+	void append(const KFASTKeypointsCSR& other) {
+		const uint32_t base = static_cast<uint32_t>(xs.size());
+		for (size_t r = row_ptr.size(); r < other.row_ptr.size(); ++r) row_ptr.push_back(base + other.row_ptr[r]);
+		xs.insert(xs.end(), other.xs.begin(), other.xs.end());
+		scores.insert(scores.end(), other.scores.begin(), other.scores.end());
+	}
+
+	// indexes all rows up to 'rows', plus the end sentinel
+	void finish(const int32_t rows) {
+		while (static_cast<int32_t>(row_ptr.size()) <= rows) row_ptr.push_back(static_cast<uint32_t>(xs.size()));
+	}
+
+private:
+	std::vector<int32_t> xs;
+	std::vector<uint8_t> scores;
+	std::vector<uint32_t> row_ptr;
+};
+
+template <typename Keypoints>
+struct _KFASTOutput;
+
+// 1-bit-per-pixel corner mask in a caller-provided bit image: for each
+// corner (x, y), bit x % 64 of word x / 64 of row y is set, with rows
+// 'words_per_row' 64-bit words apart (by default just enough for 'cols').
+// Without non-max suppression, KFAST ORs each 32-pixel corner mask
+// straight into it, with no per-corner work at all.
+// KFAST clears the mask before detecting into it.
+class KFASTCornerMask {
+public:
+	KFASTCornerMask(uint64_t* const _bits, const int32_t _cols, const int32_t _rows, const int32_t _words_per_row = 0) :
+		bits(_bits), cols(_cols), rows(_rows), words_per_row(_words_per_row ? _words_per_row : (_cols + 63) >> 6) {}
+
+	void clear() {
+		if (!band) memset(bits, 0, static_cast<size_t>(rows) * words_per_row * sizeof(uint64_t));
+	}
+
+	void reserve(size_t) {}
+
+	void emplace_back(const int32_t x, const int32_t y, uint8_t) {
+		row(y)[x >> 6] |= uint64_t(1) << (x & 63);
+	}
+
+	void emplaceMask(const uint32_t mask, const int32_t x0, const int32_t y) {
+		if (!mask) return;
+		uint64_t* const words = row(y) + (x0 >> 6);
+		const int32_t shift = x0 & 63;
+		words[0] |= static_cast<uint64_t>(mask) << shift;
+
+		// only touch the next word if bits spill into it: it may lie past the row
+		if (shift > 32) {
+			const uint64_t spill = static_cast<uint64_t>(mask) >> (64 - shift);
+			if (spill) words[1] |= spill;
+		}
+	}
+
+	bool test(const int32_t x, const int32_t y) const {
+		return (row(y)[x >> 6] >> (x & 63)) & 1;
+	}
+
+	// whether (x, y) lies within the mask
+	bool contains(const int32_t x, const int32_t y) const { return x >= 0 && x < cols && y >= 0 && y < rows; }
+
+	// number of corners marked
+	size_t count() const {
+		size_t ret = 0;
+		for (size_t k = 0; k < static_cast<size_t>(rows) * words_per_row; ++k) ret += static_cast<size_t>(_mm_popcnt_u64(bits[k]));
+		return ret;
+	}
+
+	uint64_t* row(const int32_t y) const { return bits + static_cast<ptrdiff_t>(y) * words_per_row; }
+
+private:
+	friend struct _KFASTOutput<KFASTCornerMask>;
+
+	uint64_t* bits;
+	int32_t cols;
+	int32_t rows;
+	int32_t words_per_row;
+
+	// bands share the caller's mask, each writing only its own rows
+	bool band = false;
+};
+
+// Dense score map in a caller-provided uint8 image 'stride' bytes per row:
+// each corner's score at its pixel, 0 everywhere else. Corners are scored
+// even without non-max suppression; with it, only the maxima are kept.
+// KFAST clears the map before detecting into it.
+class KFASTScoreMap {
+public:
+	KFASTScoreMap(uint8_t* const _map, const int32_t _cols, const int32_t _rows, const int32_t _stride = 0) :
+		map(_map), cols(_cols), rows(_rows), stride(_stride ? _stride : _cols) {}
+
+	void clear() {
+		if (!band) for (int32_t y = 0; y < rows; ++y) memset(row(y), 0, cols);
+	}
+
+	void reserve(size_t) {}
+
+	void emplace_back(const int32_t x, const int32_t y, const uint8_t score) { row(y)[x] = score; }
+
+	// whether (x, y) lies within the map
+	bool contains(const int32_t x, const int32_t y) const { return x >= 0 && x < cols && y >= 0 && y < rows; }
+
+	uint8_t* row(const int32_t y) const { return map + static_cast<ptrdiff_t>(y) * stride; }
+
+private:
+	friend struct _KFASTOutput<KFASTScoreMap>;
+
+	uint8_t* map;
+	int32_t cols;
+	int32_t rows;
+	int32_t stride;
+
+	// bands share the caller's map, each writing only its own rows
+	bool band = false;
+};
+
+// Output that hands each keypoint straight to a functor as fn(x, y, score),
+// so consumers can filter, count, bucket or describe keypoints on the fly
+// with no intermediate vector. The call inlines just as the vector's
+// emplace_back does (std::vector is simply the built-in sink).
+//
+//     size_t n = 0;
+//     auto sink = makeKFASTSink([&n](int32_t x, int32_t y, uint8_t score) { ++n; });
+//     KFAST<false, true>(data, cols, rows, stride, sink, threshold);
+//
+// Each band calls the functor for its own rows in raster order, but with
+// multithreading bands run concurrently, so the functor must then be
+// thread-safe; single-threaded KFAST delivers the whole image in raster order.
+// If 'scored', corners are scored even without non-max suppression.
+template <typename F, const bool scored = false>
+class KFASTSink {
+public:
+	explicit KFASTSink(F _fn) : fn(std::move(_fn)) {}
+
+	void clear() {}
+	void reserve(size_t) {}
+
+	void emplace_back(const int32_t x, const int32_t y, const uint8_t score) { fn(x, y, score); }
+
+	F& functor() { return fn; }
+
+private:
+	F fn;
+};
+
+// what each band of a multithreaded KFASTSink writes to
+template <typename F, const bool scored>
+struct _KFASTSinkBand {
+	F* fn;
+
+	void clear() {}
+	void reserve(size_t) {}
+
+	void emplace_back(const int32_t x, const int32_t y, const uint8_t score) { (*fn)(x, y, score); }
+};
+
+template <const bool scored = false, typename F>
+KFASTSink<F, scored> makeKFASTSink(F fn) {
+	return KFASTSink<F, scored>(std::move(fn));
+}
+
+// Order in which KFASTOrdered lays out keypoints.
+enum class KFASTOrder {
+	// row by row, as plain KFAST
+	Raster,
+
+	// tile by tile, tiles in raster order
+	Tiles,
+
+	// tile by tile, tiles along a Z-order (Morton) curve
+	Morton
+};
+
+// spreads the low 16 bits of 'v' out to the even bits
+inline uint32_t _KFASTSpread(uint32_t v) {
+	v = (v | (v << 8)) & 0x00FF00FF;
+	v = (v | (v << 4)) & 0x0F0F0F0F;
+	v = (v | (v << 2)) & 0x33333333;
+	return (v | (v << 1)) & 0x55555555;
+}
+
+// Z-order index of (x, y), both < 65536. Shifts rather than _pdep_u32,
+// which is microcoded and very slow on AMD before Zen 3.
+inline uint32_t _KFASTMorton(const uint32_t x, const uint32_t y) {
+	return _KFASTSpread(x) | (_KFASTSpread(y) << 1);
+}
+
+// Keypoints written to 'out' grouped by square image tile instead of row by
+// row, so that stages sampling a patch around each keypoint (descriptors,
+// orientation) keep the image around a few tiles hot in cache rather than
+// striding across whole rows of a large image between keypoints.
+// Keypoints within a tile stay in raster order. KFAST stages each band's
+// keypoints and the merge is a stable counting sort by tile, one pass
+// counting keypoints per tile and one scattering them into place; when
+// there are fewer keypoints than tiles it's a stable comparison sort instead.
+// 'tile' is rounded up to a power of two, at least 8.
+template <typename KeypointT = Keypoint>
+class KFASTOrdered {
+public:
+	KFASTOrdered(std::vector<KeypointT>& _out, const KFASTOrder _order, const int32_t tile = 32) : out(_out), order(_order) {
+		while ((1 << shift) < tile && shift < 15) ++shift;
+	}
+
+	void clear() {
+		staged.clear();
+		bands.clear();
+	}
+
+	void reserve(const size_t count) { staged.reserve(count); }
+
+	void emplace_back(const int32_t x, const int32_t y, const uint8_t score) { staged.emplace_back(x, y, score); }
+
+private:
+	friend struct _KFASTOutput<KFASTOrdered>;
+
+	uint32_t key(const KeypointT& kp, const uint32_t tiles_x) const {
+		const uint32_t tx = static_cast<uint32_t>(kp.x) >> shift;
+		const uint32_t ty = static_cast<uint32_t>(kp.y) >> shift;
+		return order == KFASTOrder::Tiles ? ty * tiles_x + tx : _KFASTMorton(tx, ty);
+	}
+
+	// lays out the staged keypoints, or the bands' in band order, in 'out'
+	void finish(const int32_t cols, const int32_t rows) {
+		if (bands.empty()) bands.push_back(&staged);
+		out.clear();
+		if (order == KFASTOrder::Raster || cols <= 0 || rows <= 0) {
+			for (const std::vector<KeypointT>* band : bands) out.insert(out.end(), band->begin(), band->end());
+			return;
+		}
+		const uint32_t tiles_x = static_cast<uint32_t>(cols - 1) >> shift;
+		const uint32_t tiles_y = static_cast<uint32_t>(rows - 1) >> shift;
+		const uint32_t buckets = (order == KFASTOrder::Tiles ? (tiles_y + 1) * (tiles_x + 1) : _KFASTMorton(tiles_x, tiles_y) + 1);
+
+		// With more tiles than keypoints (small tiles on a large frame, where
+		// the Morton range also has gaps) clearing the histogram would cost
+		// more than the keypoints themselves, so sort by tile instead.
+		size_t total = 0;
+		for (const std::vector<KeypointT>* band : bands) total += band->size();
+		if (total < buckets) {
+			for (const std::vector<KeypointT>* band : bands) out.insert(out.end(), band->begin(), band->end());
+			std::stable_sort(out.begin(), out.end(), [this, tiles_x](const KeypointT& a, const KeypointT& b) {
+				return key(a, tiles_x + 1) < key(b, tiles_x + 1);
+			});
+			return;
+		}
+
+		counts.assign(buckets + 1, 0);
+		for (const std::vector<KeypointT>* band : bands) {
+			for (const KeypointT& kp : *band) ++counts[key(kp, tiles_x + 1) + 1];
+		}
+		for (uint32_t b = 0; b < buckets; ++b) counts[b + 1] += counts[b];
+		out.resize(counts[buckets]);
+		for (const std::vector<KeypointT>* band : bands) {
+			for (const KeypointT& kp : *band) out[counts[key(kp, tiles_x + 1)]++] = kp;
+		}
+	}
+
+	std::vector<KeypointT>& out;
+	KFASTOrder order;
+	int32_t shift = 3;
+	std::vector<KeypointT> staged;
+
+	// bands merged so far, still owned by KFAST until finish()
+	std::vector<const std::vector<KeypointT>*> bands;
+
+	// per-tile counts, then the next free slot of each tile in 'out'
+	std::vector<uint32_t> counts;
+};
+
+// A band of KFASTScoreSorted: its keypoints in raster order plus a histogram of their scores.
+template <typename KeypointT>
+struct _KFASTScoreBand {
+	std::vector<KeypointT> kps;
+	uint32_t counts[256] = {};
+
+	void clear() {
+		kps.clear();
+		memset(counts, 0, sizeof(counts));
+	}
+
+	void reserve(const size_t count) { kps.reserve(count); }
+
+	void emplace_back(const int32_t x, const int32_t y, const uint8_t score) {
+		kps.emplace_back(x, y, score);
+		++counts[score];
+	}
+};
+
+// Keypoints written to 'out' by descending score, ties in raster order,
+// for consumers that keep only the strongest. Scores are 8-bit, so this is
+// a counting sort folded into detection: each band counts its scores as it
+// emits keypoints, and the merge sums the histograms and scatters every band
+// straight into place. Only the best 'keep' keypoints are written (all by
+// default). Corners are scored even without non-max suppression.
+template <typename KeypointT = Keypoint>
+class KFASTScoreSorted {
+public:
+	explicit KFASTScoreSorted(std::vector<KeypointT>& _out, const size_t _keep = SIZE_MAX) : out(_out), keep(_keep) {}
+
+	void clear() {
+		staged.clear();
+		bands.clear();
+	}
+
+	void reserve(const size_t count) { staged.reserve(count); }
+
+	void emplace_back(const int32_t x, const int32_t y, const uint8_t score) { staged.emplace_back(x, y, score); }
+
+private:
+	friend struct _KFASTOutput<KFASTScoreSorted>;
+
+	// lays out the staged keypoints, or the bands' in band order, in 'out'
+	void finish() {
+		if (bands.empty()) bands.push_back(&staged);
+		uint32_t next[256];
+		uint32_t total = 0;
+		for (int32_t s = 255; s >= 0; --s) {
+			next[s] = total;
+			for (const _KFASTScoreBand<KeypointT>* band : bands) total += band->counts[s];
+		}
+		out.clear();
+		out.resize(std::min(static_cast<size_t>(total), keep));
+		const uint32_t n = static_cast<uint32_t>(out.size());
+		for (const _KFASTScoreBand<KeypointT>* band : bands) {
+			for (const KeypointT& kp : band->kps) {
+				const uint32_t i = next[kp.score]++;
+				if (i < n) out[i] = kp;
+			}
+		}
+	}
+
+	std::vector<KeypointT>& out;
+	size_t keep;
+	_KFASTScoreBand<KeypointT> staged;
+
+	// bands merged so far, still owned by KFAST until finish()
+	std::vector<const _KFASTScoreBand<KeypointT>*> bands;
+};
+
+// Emits the corners flagged in 'mask' as (x0 + bit, y) without scores.
+template <typename Keypoints>
+inline void _KFASTEmitMask(Keypoints& keypoints, uint32_t mask, const int32_t x0, const int32_t y) {
+	while (mask) {
+		keypoints.emplace_back(x0 + static_cast<int32_t>(_tzcnt_u32(mask)), y, uint8_t(0));
+		mask = _blsr_u32(mask);
+	}
+}
+
+inline void _KFASTEmitMask(KFASTKeypointsSoA& keypoints, const uint32_t mask, const int32_t x0, const int32_t y) {
+	keypoints.emplaceMask(mask, x0, y);
+}
+
+inline void _KFASTEmitMask(KFASTCornerMask& keypoints, const uint32_t mask, const int32_t x0, const int32_t y) {
+	keypoints.emplaceMask(mask, x0, y);
+}
+
+// How multithreaded KFAST stages each band's output (of type Band) and
+// merges it, and what it does to the output once complete.
+// Any std::vector works as is, with band vectors sharing its allocator.
+template <typename Keypoints>
+struct _KFASTOutput {
+	typedef Keypoints Band;
+	typedef typename std::allocator_traits<typename Keypoints::allocator_type>::template rebind_alloc<Band> BandAlloc;
+
+	static BandAlloc bandAlloc(const Keypoints& keypoints) { return BandAlloc(keypoints.get_allocator()); }
+	static Band band(const Keypoints&, const BandAlloc& alloc) { return Band(typename Keypoints::allocator_type(alloc)); }
+	static void append(Keypoints& keypoints, const Band& band) { keypoints.insert(keypoints.end(), band.begin(), band.end()); }
+	static void finish(Keypoints&, int32_t, int32_t) {}
+
+	// whether to score corners even without non-max suppression
+	static constexpr bool scores = false;
+};
+
+template <>
+struct _KFASTOutput<KFASTKeypointsSoA> {
+	typedef KFASTKeypointsSoA Band;
+	typedef std::allocator<Band> BandAlloc;
+
+	static BandAlloc bandAlloc(const KFASTKeypointsSoA&) { return BandAlloc(); }
+	static KFASTKeypointsSoA band(const KFASTKeypointsSoA&, const BandAlloc&) { return KFASTKeypointsSoA(); }
+	static void append(KFASTKeypointsSoA& keypoints, const KFASTKeypointsSoA& band) { keypoints.append(band); }
+	static void finish(KFASTKeypointsSoA&, int32_t, int32_t) {}
+	static constexpr bool scores = false;
+};
+
+template <>
+struct _KFASTOutput<KFASTKeypointsCSR> {
+	typedef KFASTKeypointsCSR Band;
+	typedef std::allocator<Band> BandAlloc;
+
+	static BandAlloc bandAlloc(const KFASTKeypointsCSR&) { return BandAlloc(); }
+	static KFASTKeypointsCSR band(const KFASTKeypointsCSR&, const BandAlloc&) { return KFASTKeypointsCSR(); }
+	static void append(KFASTKeypointsCSR& keypoints, const KFASTKeypointsCSR& band) { keypoints.append(band); }
+	static void finish(KFASTKeypointsCSR& keypoints, int32_t, const int32_t rows) { keypoints.finish(rows); }
+	static constexpr bool scores = false;
+};
+
+template <>
+struct _KFASTOutput<KFASTCornerMask> {
+	typedef KFASTCornerMask Band;
+	typedef std::allocator<Band> BandAlloc;
+
+	static BandAlloc bandAlloc(const KFASTCornerMask&) { return BandAlloc(); }
+	static KFASTCornerMask band(const KFASTCornerMask& keypoints, const BandAlloc&) {
+		KFASTCornerMask ret = keypoints;
+		ret.band = true;
+		return ret;
+	}
+	static void append(KFASTCornerMask&, const KFASTCornerMask&) {}
+	static void finish(KFASTCornerMask&, int32_t, int32_t) {}
+	static constexpr bool scores = false;
+};
+
+template <>
+struct _KFASTOutput<KFASTScoreMap> {
+	typedef KFASTScoreMap Band;
+	typedef std::allocator<Band> BandAlloc;
+
+	static BandAlloc bandAlloc(const KFASTScoreMap&) { return BandAlloc(); }
+	static KFASTScoreMap band(const KFASTScoreMap& keypoints, const BandAlloc&) {
+		KFASTScoreMap ret = keypoints;
+		ret.band = true;
+		return ret;
+	}
+	static void append(KFASTScoreMap&, const KFASTScoreMap&) {}
+	static void finish(KFASTScoreMap&, int32_t, int32_t) {}
+	static constexpr bool scores = true;
+};
+
+// bands call the caller's functor directly
+template <typename F, const bool scored>
+struct _KFASTOutput<KFASTSink<F, scored>> {
+	typedef _KFASTSinkBand<F, scored> Band;
+	typedef std::allocator<Band> BandAlloc;
+
+	static BandAlloc bandAlloc(const KFASTSink<F, scored>&) { return BandAlloc(); }
+	static Band band(KFASTSink<F, scored>& keypoints, const BandAlloc&) {
+		Band ret = { &keypoints.functor() };
+		return ret;
+	}
+	static void append(KFASTSink<F, scored>&, const Band&) {}
+	static void finish(KFASTSink<F, scored>&, int32_t, int32_t) {}
+	static constexpr bool scores = scored;
+};
+
+template <typename F, const bool scored>
+struct _KFASTOutput<_KFASTSinkBand<F, scored>> {
+	static constexpr bool scores = scored;
+};
+
+// bands are plain vectors, left in place and scattered straight into the output
+template <typename KeypointT>
+struct _KFASTOutput<KFASTOrdered<KeypointT>> {
+	typedef std::vector<KeypointT> Band;
+	typedef std::allocator<Band> BandAlloc;
+
+	static BandAlloc bandAlloc(const KFASTOrdered<KeypointT>&) { return BandAlloc(); }
+	static Band band(const KFASTOrdered<KeypointT>&, const BandAlloc&) { return Band(); }
+	static void append(KFASTOrdered<KeypointT>& keypoints, const Band& band) { keypoints.bands.push_back(&band); }
+	static void finish(KFASTOrdered<KeypointT>& keypoints, const int32_t cols, const int32_t rows) { keypoints.finish(cols, rows); }
+	static constexpr bool scores = false;
+};
+
+template <typename KeypointT>
+struct _KFASTOutput<KFASTScoreSorted<KeypointT>> {
+	typedef _KFASTScoreBand<KeypointT> Band;
+	typedef std::allocator<Band> BandAlloc;
+
+	static BandAlloc bandAlloc(const KFASTScoreSorted<KeypointT>&) { return BandAlloc(); }
+	static Band band(const KFASTScoreSorted<KeypointT>&, const BandAlloc&) { return Band(); }
+	static void append(KFASTScoreSorted<KeypointT>& keypoints, const Band& band) { keypoints.bands.push_back(&band); }
+	static void finish(KFASTScoreSorted<KeypointT>& keypoints, int32_t, int32_t) { keypoints.finish(); }
+	static constexpr bool scores = true;
+};
+
+template <typename KeypointT>
+struct _KFASTOutput<_KFASTScoreBand<KeypointT>> {
+	static constexpr bool scores = true;
+};
+
+// Column strips of a scored output: plain keypoint vectors that still get scores.
+struct _KFASTScoredStrip {
+	std::vector<Keypoint>& keypoints;
+
+	void reserve(const size_t count) { keypoints.reserve(count); }
+	void emplace_back(const int32_t x, const int32_t y, const uint8_t score) { keypoints.emplace_back(x, y, score); }
+};
+
+template <>
+struct _KFASTOutput<_KFASTScoredStrip> {
+	static constexpr bool scores = true;
+};
+
 // Yes, this function MUST be inlined.
 // Even if your compiler thinks otherwise.
 // 2000 -> 2600 microseconds without forced inlining.
-template<const bool full, const bool nonmax_suppression>
+template<const bool full, const bool nonmax_suppression, typename Keypoints>
 #ifdef _MSC_VER
 __forceinline
 #else
@@ -86,7 +791,7 @@ inline __attribute__((always_inline))
 void processCols(int32_t& num_corners, const uint8_t* __restrict & ptr, int32_t& j,
 	const int32_t* const __restrict offsets, const __m256i& ushft, const __m256i& t, const int32_t cols,
 	const __m256i& consec, int32_t* const __restrict corners, uint8_t* const __restrict cur,
-	std::vector<Keypoint>& keypoints, const int32_t i, const int32_t start_row) {
+	Keypoints& keypoints, const int32_t i, const int32_t start_row) {
 	// ppt is an integer vector that now holds 32 of point p
 	__m256i ppt = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
 
@@ -205,102 +910,398 @@ void processCols(int32_t& num_corners, const uint8_t* __restrict & ptr, int32_t&
 		static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_max_epu8(ppt_max, pmt_max), consec))) :
 		static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_max_epu8(ppt_max, pmt_max), consec))) & last_cols_mask;
 
+	// without NMS, only outputs that want scores need more than the mask
+	if (!nonmax_suppression && !_KFASTOutput<Keypoints>::scores) {
+		_KFASTEmitMask(keypoints, m, j, start_row + i);
+		return;
+	}
+
 	// visit each corner in the mask
 	while (m) {
 		const uint32_t x = _tzcnt_u32(m);
 		m = _blsr_u32(m);
-		if (nonmax_suppression) {
-			// add it!
-			corners[num_corners++] = j + x;
 
-			// --- BEGIN COMPUTE CORNER SCORE ---
+		// add it!
+		if (nonmax_suppression) corners[num_corners++] = j + x;
 
-			// inlining gives measurably better performance
+		// --- BEGIN COMPUTE CORNER SCORE ---
 
-			const uint8_t* ptrpk = ptr + x;
+		// inlining gives measurably better performance
 
-			// the actual offsets value of point p
-			const int16_t p = static_cast<int16_t>(*ptrpk);
+		const uint8_t* ptrpk = ptr + x;
 
-			int16_t ring[24];
-			for (int n = 0; n < 24; ++n) ring[n] = p - static_cast<int16_t>(ptrpk[offsets[n]]);
+		// the actual offsets value of point p
+		const int16_t p = static_cast<int16_t>(*ptrpk);
 
-			int16_t* ringp = ring;
+		int16_t ring[24];
+		for (int n = 0; n < 24; ++n) ring[n] = p - static_cast<int16_t>(ptrpk[offsets[n]]);
 
-			// points 0-15
-			__m256i ringv = _mm256_loadu_si256(reinterpret_cast<__m256i*>(ringp++));
+		int16_t* ringp = ring;
 
-			// points 1-16
-			__m256i ringv2 = _mm256_loadu_si256(reinterpret_cast<__m256i*>(ringp++));
-			__m256i minv = _mm256_min_epi16(ringv, ringv2);
-			__m256i maxv = _mm256_max_epi16(ringv, ringv2);
+		// points 0-15
+		__m256i ringv = _mm256_loadu_si256(reinterpret_cast<__m256i*>(ringp++));
 
-			// points 2-17
-			ringv = _mm256_loadu_si256(reinterpret_cast<__m256i*>(ringp++));
-			minv = _mm256_min_epi16(minv, ringv);
-			maxv = _mm256_max_epi16(maxv, ringv);
+		// points 1-16
+		__m256i ringv2 = _mm256_loadu_si256(reinterpret_cast<__m256i*>(ringp++));
+		__m256i minv = _mm256_min_epi16(ringv, ringv2);
+		__m256i maxv = _mm256_max_epi16(ringv, ringv2);
 
-			// points 3-18
-			ringv = _mm256_loadu_si256(reinterpret_cast<__m256i*>(ringp++));
-			minv = _mm256_min_epi16(minv, ringv);
-			maxv = _mm256_max_epi16(maxv, ringv);
+		// points 2-17
+		ringv = _mm256_loadu_si256(reinterpret_cast<__m256i*>(ringp++));
+		minv = _mm256_min_epi16(minv, ringv);
+		maxv = _mm256_max_epi16(maxv, ringv);
 
-			// points 4-19
-			ringv = _mm256_loadu_si256(reinterpret_cast<__m256i*>(ringp++));
-			minv = _mm256_min_epi16(minv, ringv);
-			maxv = _mm256_max_epi16(maxv, ringv);
+		// points 3-18
+		ringv = _mm256_loadu_si256(reinterpret_cast<__m256i*>(ringp++));
+		minv = _mm256_min_epi16(minv, ringv);
+		maxv = _mm256_max_epi16(maxv, ringv);
 
-			// points 5-20
-			ringv = _mm256_loadu_si256(reinterpret_cast<__m256i*>(ringp++));
-			minv = _mm256_min_epi16(minv, ringv);
-			maxv = _mm256_max_epi16(maxv, ringv);
+		// points 4-19
+		ringv = _mm256_loadu_si256(reinterpret_cast<__m256i*>(ringp++));
+		minv = _mm256_min_epi16(minv, ringv);
+		maxv = _mm256_max_epi16(maxv, ringv);
 
-			// points 6-21
-			ringv = _mm256_loadu_si256(reinterpret_cast<__m256i*>(ringp++));
-			minv = _mm256_min_epi16(minv, ringv);
-			maxv = _mm256_max_epi16(maxv, ringv);
+		// points 5-20
+		ringv = _mm256_loadu_si256(reinterpret_cast<__m256i*>(ringp++));
+		minv = _mm256_min_epi16(minv, ringv);
+		maxv = _mm256_max_epi16(maxv, ringv);
 
-			// points 7-22
-			ringv = _mm256_loadu_si256(reinterpret_cast<__m256i*>(ringp++));
-			minv = _mm256_min_epi16(minv, ringv);
-			maxv = _mm256_max_epi16(maxv, ringv);
+		// points 6-21
+		ringv = _mm256_loadu_si256(reinterpret_cast<__m256i*>(ringp++));
+		minv = _mm256_min_epi16(minv, ringv);
+		maxv = _mm256_max_epi16(maxv, ringv);
 
-			// points 8-23
-			ringv = _mm256_loadu_si256(reinterpret_cast<__m256i*>(ringp));
-			minv = _mm256_min_epi16(minv, ringv);
-			maxv = _mm256_max_epi16(maxv, ringv);
+		// points 7-22
+		ringv = _mm256_loadu_si256(reinterpret_cast<__m256i*>(ringp++));
+		minv = _mm256_min_epi16(minv, ringv);
+		maxv = _mm256_max_epi16(maxv, ringv);
 
-			// minv now has the smallest of [0-8], [1-9], ..., [14-6], [15-7] (all 16 possible regions of 9 pixels)
-			// maxv now has the largest of  [0-8], [1-9], ..., [14-6], [15-7] (all 16 possible regions of 9 pixels)
+		// points 8-23
+		ringv = _mm256_loadu_si256(reinterpret_cast<__m256i*>(ringp));
+		minv = _mm256_min_epi16(minv, ringv);
+		maxv = _mm256_max_epi16(maxv, ringv);
 
-			// inside expression is just the negation of maxv
-			// to get expression of absolute deviation from center offsets, resulting in
-			// the greatest deviation among:
-			// [0-8], [1-9], ..., [14-6], [15-7] (all 16 possible regions of 9 pixels)
+		// minv now has the smallest of [0-8], [1-9], ..., [14-6], [15-7] (all 16 possible regions of 9 pixels)
+		// maxv now has the largest of  [0-8], [1-9], ..., [14-6], [15-7] (all 16 possible regions of 9 pixels)
 
-			maxv = _mm256_max_epi16(minv, _mm256_sub_epi16(_mm256_setzero_si256(), maxv));
+		// inside expression is just the negation of maxv
+		// to get expression of absolute deviation from center offsets, resulting in
+		// the greatest deviation among:
+		// [0-8], [1-9], ..., [14-6], [15-7] (all 16 possible regions of 9 pixels)
 
-			// The overall single max is now found through a horizontal reduction of 'maxv'.
-			// This score represents the deviation of the most deviant region of 9 pixels.
-			// _mm_minpos_epu16() emits the phminposuw instruction from SSE4. Have to
-			// correct for signed->unsigned, and also for max, not min. Can shift into
-			// the correct space with just a single subtract operation.
-			cur[j + x] = static_cast<uint8_t>(_mm_cvtsi128_si32(_mm_sub_epi16(_mm_set1_epi16(32767),
-				_mm_minpos_epu16(_mm_sub_epi16(_mm_set1_epi16(32767),
-					_mm_max_epi16(_mm256_extracti128_si256(maxv, 1), _mm256_castsi256_si128(maxv)))))));
+		maxv = _mm256_max_epi16(minv, _mm256_sub_epi16(_mm256_setzero_si256(), maxv));
 
-			// --- END COMPUTE CORNER SCORE ---
+		// The overall single max is now found through a horizontal reduction of 'maxv'.
+		// This score represents the deviation of the most deviant region of 9 pixels.
+		// _mm_minpos_epu16() emits the phminposuw instruction from SSE4. Have to
+		// correct for signed->unsigned, and also for max, not min. Can shift into
+		// the correct space with just a single subtract operation.
+		const uint8_t score = static_cast<uint8_t>(_mm_cvtsi128_si32(_mm_sub_epi16(_mm_set1_epi16(32767),
+			_mm_minpos_epu16(_mm_sub_epi16(_mm_set1_epi16(32767),
+				_mm_max_epi16(_mm256_extracti128_si256(maxv, 1), _mm256_castsi256_si128(maxv)))))));
+		if (nonmax_suppression) cur[j + x] = score;
+		else keypoints.emplace_back(j + x, start_row + i, score);
 
+		// --- END COMPUTE CORNER SCORE ---
+	}
+}
+
+// Page-aligned buffer, optionally on 2 MB pages to cut dTLB misses on
+// large frames. Huge pages come from hugetlbfs if any are reserved, else
+// from transparent huge pages via madvise(MADV_HUGEPAGE). Where neither
+// works (or off Linux) it quietly falls back to ordinary 4 KB pages.
+class KFASTBuffer {
+public:
+	KFASTBuffer() = default;
+
+	KFASTBuffer(const size_t _bytes, const bool huge) : bytes(_bytes), huge_requested(huge) {
+#ifdef __linux__
+		if (huge && bytes) {
+			constexpr size_t page = 2 << 20;
+			const size_t len = (bytes + page - 1) & ~(page - 1);
+#ifdef MAP_HUGETLB
+			void* const p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (p != MAP_FAILED) {
+				ptr = static_cast<uint8_t*>(p);
+				mapped = len;
+				huge_pages = true;
+				return;
+			}
+#endif
+			// map one page extra so that a 2 MB-aligned range fits, then trim it
+			uint8_t* const raw = static_cast<uint8_t*>(mmap(nullptr, len + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+			if (raw != MAP_FAILED) {
+				uint8_t* const aligned = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(raw) + page - 1) & ~(page - 1));
+				if (aligned > raw) munmap(raw, aligned - raw);
+				munmap(aligned + len, raw + page - aligned);
+				ptr = aligned;
+				mapped = len;
+				huge_pages = madvise(ptr, len, MADV_HUGEPAGE) == 0;
+				return;
+			}
 		}
-		else {
-			keypoints.emplace_back(j + x, start_row + i, uint8_t(0));
+#endif
+		if (bytes) {
+			ptr = reinterpret_cast<uint8_t*>(_mm_malloc(bytes, 4096));
+			if (!ptr) throw std::bad_alloc();
 		}
 	}
+
+	KFASTBuffer(KFASTBuffer&& other) noexcept { swap(other); }
+	KFASTBuffer& operator=(KFASTBuffer&& other) noexcept {
+		KFASTBuffer(std::move(other)).swap(*this);
+		return *this;
+	}
+
+	~KFASTBuffer() {
+#ifdef __linux__
+		if (mapped) {
+			munmap(ptr, mapped);
+			return;
+		}
+#endif
+		if (ptr) _mm_free(ptr);
+	}
+
+	uint8_t* get() const { return ptr; }
+	size_t size() const { return bytes; }
+
+	// whether 2 MB pages were asked for, and whether they were (probably) granted;
+	// transparent huge pages are best-effort even after a successful madvise
+	bool hugeRequested() const { return huge_requested; }
+	bool huge() const { return huge_pages; }
+
+private:
+	void swap(KFASTBuffer& other) {
+		std::swap(ptr, other.ptr);
+		std::swap(bytes, other.bytes);
+		std::swap(mapped, other.mapped);
+		std::swap(huge_requested, other.huge_requested);
+		std::swap(huge_pages, other.huge_pages);
+	}
+
+	uint8_t* ptr = nullptr;
+	size_t bytes = 0;
+	size_t mapped = 0;
+	bool huge_requested = false;
+	bool huge_pages = false;
+};
+
+// Largest supported non-max suppression radius (a 25x25 window). The band
+// halo of 3 + radius rows then still fits above the second band, which
+// starts at least 16 rows down.
+constexpr int32_t KFASTMaxNMSRadius = 12;
+
+// Bytes of non-max suppression buffers _KFAST needs: a ring of 2 * radius + 1
+// score rows padded to whole vectors, the same number of corner-column rows,
+// and beyond radius 1, two padded rows for the separable max filter.
+inline size_t _KFASTNMSBytes(const int32_t cols, const int32_t radius) {
+	const size_t ring = 2 * radius + 1;
+	const size_t width = (cols + 31) & ~31;
+	return ring * width + (radius > 1 ? 2 * (width + 64) : 0) + ring * (cols + 1) * sizeof(int32_t) + 4 * sizeof(int32_t);
 }
 
-template <const bool nonmax_suppression, const bool first_thread, const bool last_thread>
-void _KFAST(const uint8_t* __restrict const data, const int32_t cols, const int32_t start_row, const int32_t rows, const int32_t stride,
-	std::vector<Keypoint>& keypoints, const uint8_t threshold) {
+// Scratch memory for one band at a time, kept across calls so that
+// steady-state detection doesn't touch the heap. Buffers only ever grow,
+// or get replaced when 'huge_pages' changes.
+class KFASTScratch {
+public:
+	// 2 * radius + 1 rows of scores and of corner columns for non-max suppression
+	uint8_t* nms(const int32_t cols, const int32_t radius = 1) { return grow(nms_buf, _KFASTNMSBytes(cols, radius)); }
+
+	// re-pitched band copy
+	uint8_t* copy(const size_t bytes) { return grow(copy_buf, bytes); }
+
+	// number of times either buffer has had to grow
+	uint64_t allocations() const { return allocs; }
+
+	// back the buffers with 2 MB pages (see KFASTBuffer)
+	bool huge_pages = false;
+
+	// per-strip keypoints and merge cursors for column tiling
+	std::vector<std::vector<Keypoint>> strip_kps;
+	std::vector<size_t> strip_pos;
+
+private:
+	uint8_t* grow(KFASTBuffer& buf, const size_t bytes) {
+		if (bytes > buf.size() || buf.hugeRequested() != huge_pages) {
+			buf = KFASTBuffer(bytes, huge_pages);
+			++allocs;
+		}
+		return buf.get();
+	}
+
+	KFASTBuffer nms_buf;
+	KFASTBuffer copy_buf;
+	uint64_t allocs = 0;
+};
+
+// Monotonic arena for keypoint vectors, reset once per frame instead of
+// freeing anything, so that detection doesn't go through the global allocator:
+//
+//     KFASTArena arena;
+//     for (;;) {
+//         {
+//             std::vector<Keypoint, KFASTArenaAllocator<Keypoint>> keypoints(arena);
+//             KFAST<true, true>(data, cols, rows, stride, keypoints, threshold);
+//             ...
+//         }
+//         arena.reset();
+//     }
+//
+// Allocation takes a lock, so bands on different threads can share an arena.
+// A frame that spills past the first block makes reset() replace all blocks
+// with one that holds it all, so the upstream heap is left alone after warmup.
+class KFASTArena {
+public:
+	explicit KFASTArena(const size_t _block_bytes = 1 << 20) : block_bytes(_block_bytes) {}
+	~KFASTArena() { release(); }
+
+	KFASTArena(const KFASTArena&) = delete;
+	KFASTArena& operator=(const KFASTArena&) = delete;
+
+	// 'align' must be a power of two no larger than 64
+	void* allocate(const size_t bytes, const size_t align) {
+		std::lock_guard<std::mutex> lock(mtx);
+		size_t at = (used + align - 1) & ~(align - 1);
+		if (!head || at + bytes > head->size) {
+			const size_t size = std::max(block_bytes, header + bytes);
+			Block* const block = reinterpret_cast<Block*>(_mm_malloc(size, 64));
+			if (!block) throw std::bad_alloc();
+			block->next = head;
+			block->size = size;
+			head = block;
+			at = header;
+			++allocs;
+		}
+		used = at + bytes;
+		footprint += bytes + align;
+		return reinterpret_cast<uint8_t*>(head) + at;
+	}
+
+	// Frees everything allocated since the last reset.
+	// Nothing allocated from the arena may be in use anymore.
+	void reset() {
+		std::lock_guard<std::mutex> lock(mtx);
+		if (head && head->next) {
+			block_bytes = std::max(block_bytes, header + footprint);
+			release();
+		}
+		used = header;
+		footprint = 0;
+	}
+
+	// number of blocks taken from the heap so far
+	uint64_t allocations() const { return allocs; }
+
+private:
+	struct Block {
+		Block* next;
+		size_t size;
+	};
+
+	// Block header, padded to keep allocations 64-byte alignable
+	static constexpr size_t header = 64;
+
+	void release() {
+		while (head) {
+			Block* const next = head->next;
+			_mm_free(head);
+			head = next;
+		}
+	}
+
+	std::mutex mtx;
+	Block* head = nullptr;
+	size_t block_bytes;
+	size_t used = header;
+	size_t footprint = 0;
+	uint64_t allocs = 0;
+};
+
+// Standard allocator drawing from a KFASTArena. Deallocation is a no-op.
+template <typename T>
+struct KFASTArenaAllocator {
+	typedef T value_type;
+
+	KFASTArenaAllocator(KFASTArena& _arena) : arena(&_arena) {}
+
+	template <typename U>
+	KFASTArenaAllocator(const KFASTArenaAllocator<U>& other) : arena(other.arena) {}
+
+	T* allocate(const size_t n) { return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T))); }
+	void deallocate(T*, size_t) {}
+
+	KFASTArena* arena;
+};
+
+template <typename T, typename U>
+bool operator==(const KFASTArenaAllocator<T>& a, const KFASTArenaAllocator<U>& b) { return a.arena == b.arena; }
+
+template <typename T, typename U>
+bool operator!=(const KFASTArenaAllocator<T>& a, const KFASTArenaAllocator<U>& b) { return a.arena != b.arena; }
+
+// Non-max suppression of radius r > 1 for the corners of ring row 'center', at image row 'y':
+// a corner survives if its score beats every other score within r rows and r columns.
+// The max is taken separably, 32 columns at a time: vertically over the ring
+// (without and with the center row), then horizontally over r columns either side.
+template <typename Keypoints>
+void _KFASTSuppress(uint8_t* const* const rowbuf, const int32_t ring, const int32_t center, const int32_t* const corners,
+	const int32_t r, const int32_t width, uint8_t* const vother, uint8_t* const vall, Keypoints& keypoints, const int32_t y) {
+	const int32_t num_corners = corners[-1];
+	if (num_corners == 0) return;
+
+	for (int32_t c = 0; c < width; c += 32) {
+		__m256i m = _mm256_setzero_si256();
+		for (int32_t k = 0; k < ring; ++k) {
+			if (k != center) m = _mm256_max_epu8(m, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rowbuf[k] + c)));
+		}
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(vother + c), m);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(vall + c), _mm256_max_epu8(m, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rowbuf[center] + c))));
+	}
+
+	// vall[c] becomes the max of vall[c, c + r) by doubling the window up to the
+	// largest power of 2 within r, then overlapping two of those.
+	// Each pass reads ahead of what it writes, so it can run in place,
+	// and starts 32 columns early to cover windows left of column 0.
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(vall - 32), _mm256_setzero_si256());
+	int32_t span = 1;
+	for (; 2 * span <= r; span *= 2) {
+		for (int32_t c = -32; c < width; c += 32) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(vall + c), _mm256_max_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(vall + c)),
+				_mm256_loadu_si256(reinterpret_cast<const __m256i*>(vall + c + span))));
+		}
+	}
+	if (span < r) {
+		for (int32_t c = -32; c < width; c += 32) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(vall + c), _mm256_max_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(vall + c)),
+				_mm256_loadu_si256(reinterpret_cast<const __m256i*>(vall + c + r - span))));
+		}
+	}
+
+	const uint8_t* const cur = rowbuf[center];
+	for (int32_t k = 0; k < num_corners; ++k) {
+		const int32_t j = corners[k];
+		const uint8_t score = cur[j];
+
+		// beats the rest of its column, the r columns to its left and the r to its right
+		if ((score > vother[j]) & (score > vall[j - r]) & (score > vall[j + 1])) keypoints.emplace_back(j, y, score);
+	}
+}
+
+// Detects the band of 'rows' rows starting at 'start_row' of the full image.
+// If 'deadline' is given and passes partway through, the band is abandoned
+// and false is returned; its keypoints are then incomplete.
+// If 'prefetch' is nonzero, row i + 4 (the next row to enter the 7-row window)
+// and the next NMS row buffer are software-prefetched 'prefetch' bytes
+// ahead of the column being processed.
+// The NMS buffers come from 'scratch' if given, else from the heap.
+// Non-max suppression is over (2 * nms_radius + 1)^2 windows; the band must
+// then have 3 + nms_radius halo rows on each side that's not the image edge.
+template <const bool nonmax_suppression, const bool first_thread, const bool last_thread, typename Keypoints>
+bool _KFAST(const uint8_t* __restrict const data, const int32_t cols, const int32_t start_row, const int32_t rows, const int32_t stride,
+	Keypoints& keypoints, const uint8_t threshold, const std::chrono::steady_clock::time_point* const deadline = nullptr,
+	const int32_t prefetch = 0, KFASTScratch* const scratch = nullptr, const int32_t nms_radius = 1) {
 	keypoints.reserve(8500);
 
 	// Rosten's circle pixels in the order 9, 8, 7, 6, 5, 4, 3, 2, 1, 16, 15, 14, 13, 12, 11, 10, then repeat 9, 8, 7, 6, 5, 4, 3, 2
@@ -320,31 +1321,55 @@ void _KFAST(const uint8_t* __restrict const data, const int32_t cols, const int3
 	// will be used for comparing number of consecutive salient pixels - greater than 8 means corner!
 	const __m256i consec = _mm256_set1_epi8(8);
 
+	// non-max suppression radius: row i - r is final once row i has been scored,
+	// so scores and corners are kept for the last 2r + 1 rows
+	const int32_t r = nonmax_suppression ? nms_radius : 0;
+	const int32_t ring = 2 * r + 1;
+	const int32_t width = (cols + 31) & ~31;
+
 	uint8_t* rawbuf;
-	uint8_t* rowbuf[3];
-	int32_t* cornerbuf[3];
+	uint8_t* rowbuf[2 * KFASTMaxNMSRadius + 1];
+	int32_t* cornerbuf[2 * KFASTMaxNMSRadius + 1];
+	uint8_t* vother = nullptr;
+	uint8_t* vall = nullptr;
 	if (nonmax_suppression) {
-		// allocate enough buffer for 3 rows of uint8_t and then 3 rows of int32_t
-		rawbuf = reinterpret_cast<uint8_t*>(_mm_malloc(cols * 3 * (sizeof(int32_t) + sizeof(uint8_t)) + 4 * sizeof(int32_t), 4096));
+		// allocate enough buffer for 'ring' rows of uint8_t, the filter rows, then 'ring' rows of int32_t
+		rawbuf = scratch ? scratch->nms(cols, r) : reinterpret_cast<uint8_t*>(_mm_malloc(_KFASTNMSBytes(cols, r), 4096));
 
 		// each rowbuf entry is a pointer to a uint8_t row buffer
-		rowbuf[0] = rawbuf;
-		rowbuf[1] = rowbuf[0] + cols;
-		rowbuf[2] = rowbuf[1] + cols;
+		for (int32_t k = 0; k < ring; ++k) rowbuf[k] = rawbuf + k * width;
+		uint8_t* next = rawbuf + ring * width;
+
+		// vertical max of the ring without and with the center row,
+		// with 32 zeroed columns either side
+		if (r > 1) {
+			memset(next, 0, 2 * (width + 64));
+			vother = next + 32;
+			vall = vother + width + 64;
+			next = vall + width + 32;
+		}
 
 		// each cornerbuf entry is a pointer to an int32_t row buffer
 		// make sure it's aligned to a 4-byte boundary
 		// and that there's space for an extra element to store num_corners
-		cornerbuf[0] = reinterpret_cast<int32_t*>((reinterpret_cast<uintptr_t>(rowbuf[2] + cols) + 3) & ~3) + 1;
-		cornerbuf[1] = cornerbuf[0] + cols + 1;
-		cornerbuf[2] = cornerbuf[1] + cols + 1;
+		cornerbuf[0] = reinterpret_cast<int32_t*>((reinterpret_cast<uintptr_t>(next) + 3) & ~3) + 1;
+		for (int32_t k = 1; k < ring; ++k) cornerbuf[k] = cornerbuf[k - 1] + cols + 1;
 
 		// zero out the uint8_t row buffers
-		memset(rowbuf[0], 0, cols * 3);
+		memset(rowbuf[0], 0, ring * width);
 	}
 
+	// the last band runs r rows past the last scored row to flush out the ring
+	const int32_t end = nonmax_suppression && last_thread ? rows - 3 + r : rows - 3;
+
+	bool completed = true;
 	int32_t j;
-	for (int32_t i = 3; i < rows - 2; ++i) {
+	for (int32_t i = 3; i < end; ++i) {
+		// checked every 8 rows to keep clock reads off the profile
+		if (deadline && (i & 7) == 0 && std::chrono::steady_clock::now() > *deadline) {
+			completed = false;
+			break;
+		}
 
 		// ptr points to the first valid offsets in the row but hasn't retrieved it yet
 		const uint8_t* ptr = data + i*stride + 3;
@@ -353,11 +1378,11 @@ void _KFAST(const uint8_t* __restrict const data, const int32_t cols, const int3
 		int32_t* corners = nullptr;
 		int32_t num_corners;
 		if (nonmax_suppression) {
-			// cur points to which row buffer we're in - pattern goes 0, 1, 2, 0, 1, 2, 0, 1, 2, ...
-			cur = rowbuf[i % 3];
+			// cur points to which row buffer we're in - pattern goes 0, 1, 2, 0, 1, 2, 0, 1, 2, ... for radius 1
+			cur = rowbuf[i % ring];
 
 			// corners does the same thing for the int32_t buffer
-			corners = cornerbuf[i % 3];
+			corners = cornerbuf[i % ring];
 
 			// zero out the current rowbuffer
 			memset(cur, 0, cols);
@@ -369,6 +1394,10 @@ void _KFAST(const uint8_t* __restrict const data, const int32_t cols, const int3
 			// jumping forward 32 cols at a time and also moving ptr forward 32 cols each time with it
 			// these calls to processCols MUST be inlined for best performance, even if your compiler thinks otherwise
 			for (j = 3; j < cols - 34; j += 32, ptr += 32) {
+				if (prefetch) {
+					_mm_prefetch(reinterpret_cast<const char*>(ptr + 4 * stride + prefetch), _MM_HINT_T0);
+					if (nonmax_suppression) _mm_prefetch(reinterpret_cast<const char*>(rowbuf[(i + 1) % ring] + j + prefetch), _MM_HINT_T0);
+				}
 				processCols<true, nonmax_suppression>(num_corners, ptr, j, offsets, ushft, t,
 					cols, consec, corners, cur, keypoints, i, start_row);
 			}
@@ -380,19 +1409,22 @@ void _KFAST(const uint8_t* __restrict const data, const int32_t cols, const int3
 		if (nonmax_suppression) {
 			corners[-1] = num_corners;
 
-			// for first thread: skip first and last row
-			// for inner threads: skip first, second, last row
-			// for last thread: skip first and second row
-			if ((!last_thread && i == rows - 3) || (!first_thread && i == 4) || i == 3) continue;
+			// row i - r is only ours from row 3 of the image, or below the halo of other threads
+			if (i < (first_thread ? 3 + r : 3 + 2 * r)) continue;
+
+			if (r > 1) {
+				_KFASTSuppress(rowbuf, ring, (i - r) % ring, cornerbuf[(i - r) % ring], r, width, vother, vall, keypoints, start_row + i - r);
+				continue;
+			}
 
 			// last buffered row
-			const uint8_t* last = rowbuf[(i - 1) % 3];
+			const uint8_t* last = rowbuf[(i - 1) % ring];
 
 			// last last buffered row
-			const uint8_t* last2 = rowbuf[(i - 2) % 3];
+			const uint8_t* last2 = rowbuf[(i - 2) % ring];
 
 			// set corners to previous buffered row
-			corners = cornerbuf[(i - 1) % 3];
+			corners = cornerbuf[(i - 1) % ring];
 
 			// retrieve previous num_corners
 			num_corners = corners[-1];
@@ -412,46 +1444,1774 @@ void _KFAST(const uint8_t* __restrict const data, const int32_t cols, const int3
 		}
 	}
 
-	if (nonmax_suppression) _mm_free(rawbuf);
+	if (nonmax_suppression && !scratch) _mm_free(rawbuf);
+	return completed;
 }
 
-template <const bool multithreading, const bool nonmax_suppression>
+// Spins on 'pred' with exponential _mm_pause backoff for up to 'spin'.
+// Returns true if 'pred' became true within the budget.
+template <typename Pred>
+inline bool KFASTSpin(const Pred& pred, const std::chrono::nanoseconds spin) {
+	if (spin.count() <= 0) return pred();
+	const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + spin;
+	uint32_t backoff = 1;
+	for (;;) {
+		if (pred()) return true;
+		for (uint32_t k = 0; k < backoff; ++k) _mm_pause();
+		// cap the backoff at ~64 pauses so wakeup latency stays in the low hundreds of ns
+		if (backoff < 64) backoff <<= 1;
+		if (std::chrono::steady_clock::now() >= deadline) return pred();
+	}
+}
+
+// Executor interface for the multithreaded KFAST path.
+// Anything that can run N tasks and wait for all of them can drive
+// KFAST<true, ...>, so detection can share cores with the rest of
+// an application instead of spawning its own threads.
+class KFASTExecutor {
+public:
+	virtual ~KFASTExecutor() {}
+
+	// number of tasks that can usefully run at once, counting the calling thread
+	virtual int32_t concurrency() const = 0;
+
+	// runs task(arg, 0) ... task(arg, n - 1), possibly concurrently,
+	// and returns once all of them have finished
+	virtual void run(int32_t n, void (*task)(void*, int32_t), void* arg) = 0;
+};
+
+// Runs every task on the calling thread.
+class KFASTInlineExecutor : public KFASTExecutor {
+public:
+	int32_t concurrency() const override { return 1; }
+
+	void run(const int32_t n, void (* const task)(void*, int32_t), void* const arg) override {
+		for (int32_t k = 0; k < n; ++k) task(arg, k);
+	}
+};
+
+// Persistent worker pool; the default KFASTExecutor.
+//
+// The calling thread always participates, so a pool of 'threads'
+// runs 'threads' - 1 workers. Idle workers (and a caller waiting for
+// completion) spin for up to 'spin' before blocking on a condition variable.
+// Completion is tracked by an atomic counter, not by futures.
+// With spin == 0 (the default) everyone blocks immediately, which is
+// kindest to other processes; a spin of a few tens of microseconds keeps
+// workers hot between frames and cuts submit-to-completion latency
+// for high-frame-rate callers.
+//
+// One job runs on the workers at a time. A caller that finds the pool
+// busy runs its job inline instead of queueing behind it, so concurrent
+// detectors never use more threads than the pool plus their own.
+// Do not call run() from within a task of the same pool.
+class KFASTPool : public KFASTExecutor {
+public:
+	explicit KFASTPool(const int32_t threads = static_cast<int32_t>(std::thread::hardware_concurrency()),
+		const std::chrono::nanoseconds spin = std::chrono::nanoseconds(0)) : spin_ns(spin.count()) {
+		for (int32_t k = 1; k < threads; ++k) workers.emplace_back(&KFASTPool::worker, this);
+	}
+
+	KFASTPool(const KFASTPool&) = delete;
+	KFASTPool& operator=(const KFASTPool&) = delete;
+
+	~KFASTPool() {
+		stop = true;
+		generation.fetch_add(1);
+		{ std::lock_guard<std::mutex> lock(mtx); }
+		wake.notify_all();
+		for (std::thread& w : workers) w.join();
+	}
+
+	int32_t concurrency() const override { return static_cast<int32_t>(workers.size()) + 1; }
+
+	std::chrono::nanoseconds spin() const { return std::chrono::nanoseconds(spin_ns.load(std::memory_order_relaxed)); }
+	void setSpin(const std::chrono::nanoseconds spin) { spin_ns.store(spin.count(), std::memory_order_relaxed); }
+
+	void run(const int32_t n, void (* const task)(void*, int32_t), void* const arg) override {
+		std::unique_lock<std::mutex> submit_lock(submit, std::try_to_lock);
+		if (workers.empty() || n <= 1 || !submit_lock.owns_lock()) {
+			for (int32_t k = 0; k < n; ++k) task(arg, k);
+			return;
+		}
+
+		// Retire the previous job (an odd generation means the next one is being
+		// written). A straggler that joins it from now on sees the generation has
+		// moved and leaves it alone; one that joined before is waited for here,
+		// so nobody reads the fields below while they're rewritten.
+		generation.fetch_add(1);
+		while (active.load()) std::this_thread::yield();
+
+		job_task = task;
+		job_arg = arg;
+		job_n = n;
+		next.store(0, std::memory_order_relaxed);
+		pending.store(n, std::memory_order_relaxed);
+
+		// publish the job. Any worker that registered as a sleeper before this point
+		// needs an explicit wakeup; any that registers after will see the new generation.
+		generation.fetch_add(1);
+		if (sleepers.load()) {
+			{ std::lock_guard<std::mutex> lock(mtx); }
+			wake.notify_all();
+		}
+
+		work();
+
+		const auto finished = [this] { return pending.load(std::memory_order_acquire) == 0; };
+		if (!KFASTSpin(finished, spin())) {
+			std::unique_lock<std::mutex> lock(mtx);
+			done.wait(lock, finished);
+		}
+	}
+
+private:
+	// Runs tasks until none are left. Completion counts tasks, not workers,
+	// so the caller never waits on a worker that is slow to wake up.
+	void work() {
+		int32_t k;
+		while ((k = next.fetch_add(1, std::memory_order_relaxed)) < job_n) {
+			job_task(job_arg, k);
+			if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				std::lock_guard<std::mutex> lock(mtx);
+				done.notify_one();
+			}
+		}
+	}
+
+	void worker() {
+		uint64_t seen = 0;
+		const auto published = [this, &seen] { return generation.load() != seen; };
+		for (;;) {
+			if (!KFASTSpin(published, spin())) {
+				std::unique_lock<std::mutex> lock(mtx);
+				sleepers.fetch_add(1);
+				wake.wait(lock, published);
+				sleepers.fetch_sub(1);
+			}
+			seen = generation.load();
+			if (stop) return;
+			if (seen & 1) continue;
+
+			// join the job only if it's still the current one (see run())
+			active.fetch_add(1);
+			if (generation.load() == seen) work();
+			active.fetch_sub(1);
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::mutex submit;
+	std::mutex mtx;
+	std::condition_variable wake;
+	std::condition_variable done;
+	std::atomic<uint64_t> generation{ 0 };
+	std::atomic<int32_t> sleepers{ 0 };
+	std::atomic<int32_t> next{ 0 };
+	std::atomic<int32_t> pending{ 0 };
+	std::atomic<int32_t> active{ 0 };
+	std::atomic<int64_t> spin_ns;
+	void (*job_task)(void*, int32_t) = nullptr;
+	void* job_arg = nullptr;
+	int32_t job_n = 0;
+	std::atomic<bool> stop{ false };
+};
+
+// Adapts a caller-owned task system. 'post' is any callable that accepts
+// a std::function<void()> and schedules it to run somewhere, e.g.
+//
+//     auto post = [&](std::function<void()> f) { my_pool.enqueue(std::move(f)); };
+//     auto executor = makeKFASTPostExecutor(post, my_pool.size());
+//     KFAST<true, true>(data, cols, rows, stride, keypoints, threshold, executor);
+//
+// The calling thread claims tasks too and only waits for tasks that have
+// actually started, so a saturated pool delays detection but can't deadlock it.
+// Posted closures that start after everything is done simply return.
+template <typename Post>
+class KFASTPostExecutor : public KFASTExecutor {
+public:
+	KFASTPostExecutor(Post _post, const int32_t _threads) : post(std::move(_post)), threads(std::max(_threads, 1)) {}
+
+	int32_t concurrency() const override { return threads; }
+
+	void run(const int32_t n, void (* const task)(void*, int32_t), void* const arg) override {
+		if (n <= 1 || threads <= 1) {
+			for (int32_t k = 0; k < n; ++k) task(arg, k);
+			return;
+		}
+
+		std::shared_ptr<State> state = std::make_shared<State>(n, task, arg);
+		for (int32_t k = 1; k < std::min(n, threads); ++k) post(std::function<void()>([state] { state->work(); }));
+		state->work();
+
+		std::unique_lock<std::mutex> lock(state->mtx);
+		state->done.wait(lock, [&state] { return state->remaining.load(std::memory_order_acquire) == 0; });
+	}
+
+private:
+	struct State {
+		State(const int32_t _n, void (* const _task)(void*, int32_t), void* const _arg) : task(_task), arg(_arg), n(_n), remaining(_n) {}
+
+		void work() {
+			int32_t k;
+			while ((k = next.fetch_add(1, std::memory_order_relaxed)) < n) {
+				task(arg, k);
+				if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+					std::lock_guard<std::mutex> lock(mtx);
+					done.notify_one();
+				}
+			}
+		}
+
+		void (*task)(void*, int32_t);
+		void* arg;
+		const int32_t n;
+		std::atomic<int32_t> next{ 0 };
+		std::atomic<int32_t> remaining;
+		std::mutex mtx;
+		std::condition_variable done;
+	};
+
+	Post post;
+	const int32_t threads;
+};
+
+template <typename Post>
+KFASTPostExecutor<Post> makeKFASTPostExecutor(Post post, const int32_t threads) {
+	return KFASTPostExecutor<Post>(std::move(post), threads);
+}
+
+// Process-wide pool used by KFAST<true, ...> when no executor is given.
+// Created on first use with one thread per hardware thread.
+inline KFASTPool& KFASTDefaultPool() {
+	static KFASTPool pool;
+	return pool;
+}
+
+// When to detect on an internal copy of each band with a different row pitch.
+enum class KFASTRepitch {
+	Never,
+
+	// only for strides KFASTStrideAliases() flags
+	Auto,
+
+	Always
+};
+
+// True if 'stride' puts several of the 7 rows read around each pixel
+// 4 KB apart (or a multiple thereof). Those rows then map to the same L1 sets,
+// and loads from them falsely depend on stores to the NMS buffers (4K aliasing).
+inline bool KFASTStrideAliases(const int32_t stride) {
+	return (stride & 2047) == 0;
+}
+
+// A row pitch >= 'cols' that doesn't alias: whole cache lines, nudged one line
+// off any multiple of 2 KB, e.g. 4096 -> 4160.
+inline int32_t KFASTPitch(const int32_t cols) {
+	const int32_t pitch = (cols + 63) & ~63;
+	return KFASTStrideAliases(pitch) ? pitch + 64 : pitch;
+}
+
+// Knobs that change how KFAST walks memory but never what it finds,
+// plus the size of the non-max suppression window.
+struct KFASTTuning {
+	// If nonzero, detect each band in full-height column strips about this wide
+	// (plus a halo of 3 pixels, 3 + nms_radius with non-max suppression) instead of full-width rows,
+	// so the 7-row window and the NMS buffers stay in L1/L2 on very wide images.
+	// ~2048 suits most CPUs; widths below 64 are rounded up to 64.
+	int32_t tile_cols = 0;
+
+	// If nonzero, software-prefetch the next image row and NMS buffer this many
+	// bytes ahead instead of relying on the hardware prefetcher alone to track
+	// all 7 row streams. Worth trying at large strides; 256-1024 is typical.
+	int32_t prefetch_dist = 0;
+
+	// Detect on a re-pitched copy of each band (see KFASTPitch) to get rid of
+	// 4K aliasing at pathological strides. The copy costs one extra pass over
+	// the band, so 'Auto' only pays it where KFASTStrideAliases() says so.
+	KFASTRepitch repitch = KFASTRepitch::Never;
+
+	// With non-max suppression, a corner is kept only if its score beats every
+	// other within this many rows and columns: 1 is the classic 3x3 window,
+	// 2 is 5x5, 3 is 7x7, up to KFASTMaxNMSRadius. Wider windows thin out the
+	// clusters of near-duplicate corners FAST finds at high resolution.
+	// Bands and column strips overlap by 3 + nms_radius pixels.
+	int32_t nms_radius = 1;
+
+	// Back the NMS buffers and re-pitched copies with 2 MB pages (see KFASTBuffer).
+	// Mapping them is expensive, so this only applies to scratch kept across
+	// calls, i.e. KFASTDetector; plain KFAST calls ignore it.
+	bool huge_pages = false;
+};
+
+// Image buffer for staging input frames, e.g. decoder output, optionally
+// on 2 MB pages. Rows are KFASTPitch(cols) apart so they don't alias either,
+// and one zeroed row past the last absorbs KFAST's vector loads past the end.
+class KFASTFrame {
+public:
+	KFASTFrame(const int32_t _cols, const int32_t _rows, const bool huge = true) :
+		cols(_cols), rows(_rows), stride(KFASTPitch(_cols)), buf(static_cast<size_t>(_rows + 1) * stride, huge) {
+		memset(buf.get(), 0, buf.size());
+	}
+
+	uint8_t* data() const { return buf.get(); }
+	uint8_t* row(const int32_t r) const { return buf.get() + static_cast<ptrdiff_t>(r) * stride; }
+
+	// whether the frame (probably) got 2 MB pages
+	bool huge() const { return buf.huge(); }
+
+	const int32_t cols;
+	const int32_t rows;
+	const int32_t stride;
+
+private:
+	KFASTBuffer buf;
+};
+
+template <const bool nonmax_suppression, typename Keypoints>
+bool _KFASTRows(const bool first, const bool last, const uint8_t* __restrict const data, const int32_t cols, const int32_t start_row,
+	const int32_t rows, const int32_t stride, Keypoints& keypoints, const uint8_t threshold,
+	const std::chrono::steady_clock::time_point* const deadline, const int32_t prefetch, KFASTScratch* const scratch, const int32_t nms_radius) {
+	if (first) {
+		if (last) return _KFAST<nonmax_suppression, true, true>(data, cols, start_row, rows, stride, keypoints, threshold, deadline, prefetch, scratch, nms_radius);
+		return _KFAST<nonmax_suppression, true, false>(data, cols, start_row, rows, stride, keypoints, threshold, deadline, prefetch, scratch, nms_radius);
+	}
+	if (last) return _KFAST<nonmax_suppression, false, true>(data, cols, start_row, rows, stride, keypoints, threshold, deadline, prefetch, scratch, nms_radius);
+	return _KFAST<nonmax_suppression, false, false>(data, cols, start_row, rows, stride, keypoints, threshold, deadline, prefetch, scratch, nms_radius);
+}
+
+// first row owned by band 'k' of 'bands'
+inline int32_t KFASTBandRow(const int32_t rows, const int32_t bands, const int32_t k) {
+	return static_cast<int32_t>(static_cast<int64_t>(rows) * k / bands);
+}
+
+// Runs the band of rows [begin_row, end_row) of the full image.
+// Each band is handed to _KFAST with enough halo rows above and below
+// that its output exactly matches the corresponding rows of a
+// single-threaded run. Returns false if 'deadline' cut the band short.
+// All temporary memory comes from 'scratch' if given.
+template <const bool nonmax_suppression, typename Keypoints>
+bool _KFASTBand(const uint8_t* __restrict const data, const int32_t cols, const int32_t rows, const int32_t stride,
+	Keypoints& keypoints, const uint8_t threshold, const int32_t begin_row, const int32_t end_row,
+	const std::chrono::steady_clock::time_point* const deadline = nullptr, const KFASTTuning& tuning = KFASTTuning(),
+	KFASTScratch* const scratch = nullptr) {
+	const int32_t nms_radius = std::min(std::max(tuning.nms_radius, 1), KFASTMaxNMSRadius);
+	const int32_t halo = 3 + (nonmax_suppression ? nms_radius : 0);
+	const bool first = begin_row == 0;
+	const bool last = end_row == rows;
+	const int32_t start_row = first ? 0 : begin_row - halo;
+	const int32_t band_rows = (last ? rows : end_row + halo) - start_row;
+	const uint8_t* band_data = data + static_cast<ptrdiff_t>(start_row) * stride;
+	int32_t pitch = stride;
+	if (scratch) scratch->huge_pages = tuning.huge_pages;
+
+	std::unique_ptr<uint8_t, void (*)(void*)> owned_copy(nullptr, _mm_free);
+	if (tuning.repitch == KFASTRepitch::Always || (tuning.repitch == KFASTRepitch::Auto && KFASTStrideAliases(stride))) {
+		pitch = KFASTPitch(cols);
+
+		// one extra zeroed row absorbs the vector loads that run past the last row
+		const size_t bytes = static_cast<size_t>(band_rows + 1) * pitch;
+		if (!scratch) owned_copy.reset(reinterpret_cast<uint8_t*>(_mm_malloc(bytes, 64)));
+		uint8_t* const copy = scratch ? scratch->copy(bytes) : owned_copy.get();
+		for (int32_t r = 0; r < band_rows; ++r) {
+			memcpy(copy + static_cast<ptrdiff_t>(r) * pitch, band_data + static_cast<ptrdiff_t>(r) * stride, cols);
+			memset(copy + static_cast<ptrdiff_t>(r) * pitch + cols, 0, pitch - cols);
+		}
+		memset(copy + static_cast<ptrdiff_t>(band_rows) * pitch, 0, pitch);
+		band_data = copy;
+	}
+
+	const int32_t tile_cols = tuning.tile_cols ? std::max(tuning.tile_cols, 64) : cols;
+	if (tile_cols >= cols) {
+		return _KFASTRows<nonmax_suppression>(first, last, band_data, cols, start_row, band_rows, pitch, keypoints, threshold,
+			deadline, tuning.prefetch_dist, scratch, nms_radius);
+	}
+
+	// Column strips. Strip s owns columns [c0, c1) and is detected over [lo, hi),
+	// which adds the same halo horizontally that bands add vertically.
+	// Each strip comes back in raster order with strip-relative x, and NMS
+	// may report corners in the halo columns, so the strips are offset,
+	// trimmed and interleaved row by row back into raster order.
+	const int32_t strips = (cols + tile_cols - 1) / tile_cols;
+	std::vector<std::vector<Keypoint>> owned_strip_kps;
+	std::vector<size_t> owned_strip_pos;
+	std::vector<std::vector<Keypoint>>& strip_kps = scratch ? scratch->strip_kps : owned_strip_kps;
+	std::vector<size_t>& pos = scratch ? scratch->strip_pos : owned_strip_pos;
+	if (static_cast<int32_t>(strip_kps.size()) < strips) strip_kps.resize(strips);
+	pos.assign(strips, 0);
+	bool completed = true;
+	for (int32_t s = 0; s < strips; ++s) {
+		const int32_t lo = s ? KFASTBandRow(cols, strips, s) - halo : 0;
+		const int32_t hi = s == strips - 1 ? cols : KFASTBandRow(cols, strips, s + 1) + halo;
+		strip_kps[s].clear();
+		if (!nonmax_suppression && _KFASTOutput<Keypoints>::scores) {
+			_KFASTScoredStrip scored = { strip_kps[s] };
+			completed &= _KFASTRows<nonmax_suppression>(first, last, band_data + lo, hi - lo, start_row, band_rows, pitch, scored, threshold,
+				deadline, tuning.prefetch_dist, scratch, nms_radius);
+		}
+		else {
+			completed &= _KFASTRows<nonmax_suppression>(first, last, band_data + lo, hi - lo, start_row, band_rows, pitch, strip_kps[s], threshold,
+				deadline, tuning.prefetch_dist, scratch, nms_radius);
+		}
+	}
+
+	for (int32_t y = begin_row; y < end_row; ++y) {
+		for (int32_t s = 0; s < strips; ++s) {
+			const int32_t lo = s ? KFASTBandRow(cols, strips, s) - halo : 0;
+			const int32_t c0 = KFASTBandRow(cols, strips, s);
+			const int32_t c1 = KFASTBandRow(cols, strips, s + 1);
+			const std::vector<Keypoint>& kps = strip_kps[s];
+			for (size_t& k = pos[s]; k < kps.size() && kps[k].y == y; ++k) {
+				const int32_t x = kps[k].x + lo;
+				if (x >= c0 && x < c1) keypoints.emplace_back(x, y, kps[k].score);
+			}
+		}
+	}
+	return completed;
+}
+
+template <const bool nonmax_suppression, typename Keypoints>
+struct _KFASTBandJob {
+	const uint8_t* data;
+	int32_t cols;
+	int32_t rows;
+	int32_t stride;
+	int32_t bands;
+	uint8_t threshold;
+	Keypoints* band_kps;
+	const KFASTTuning* tuning;
+	KFASTScratch* scratch;
+
+	static void run(void* const arg, const int32_t k) {
+		const _KFASTBandJob& job = *static_cast<const _KFASTBandJob*>(arg);
+		job.band_kps[k].clear();
+		_KFASTBand<nonmax_suppression>(job.data, job.cols, job.rows, job.stride, job.band_kps[k], job.threshold,
+			KFASTBandRow(job.rows, job.bands, k), KFASTBandRow(job.rows, job.bands, k + 1), nullptr, *job.tuning,
+			job.scratch ? job.scratch + k : nullptr);
+	}
+};
+
+// Detects bands [0, bands) into band_kps[0, bands), growing it as needed
+// with band outputs for 'keypoints'.
+template <const bool nonmax_suppression, typename Keypoints, typename Bands>
+void _KFASTBands(const uint8_t* __restrict const data, const int32_t cols, const int32_t rows, const int32_t stride,
+	Keypoints& keypoints, const uint8_t threshold, KFASTExecutor& executor, const KFASTTuning& tuning,
+	Bands& band_kps, KFASTScratch* const scratch, const int32_t bands) {
+	typedef typename Bands::value_type Band;
+	while (static_cast<int32_t>(band_kps.size()) < bands) band_kps.push_back(_KFASTOutput<Keypoints>::band(keypoints, band_kps.get_allocator()));
+	_KFASTBandJob<nonmax_suppression, Band> job = { data, cols, rows, stride, bands, threshold, band_kps.data(), &tuning, scratch };
+	executor.run(bands, &_KFASTBandJob<nonmax_suppression, Band>::run, &job);
+}
+
+// Body of KFAST and KFASTDetector::detect. 'band_kps' is grown to the
+// number of bands as needed; 'scratch' is null or has one entry per
+// unit of executor concurrency.
+template <const bool multithreading, const bool nonmax_suppression, typename Keypoints, typename Bands>
+void _KFASTRun(const uint8_t* __restrict const data, const int32_t cols, const int32_t rows, const int32_t stride,
+	Keypoints& keypoints, const uint8_t threshold, KFASTExecutor& executor, const KFASTTuning& tuning,
+	Bands& band_kps, KFASTScratch* const scratch) {
+	const int32_t bands = multithreading ? std::min(rows >> 4, executor.concurrency()) : 1;
+	keypoints.clear();
+	keypoints.reserve(8500);
+	if (bands <= 1) {
+		_KFASTBand<nonmax_suppression>(data, cols, rows, stride, keypoints, threshold, 0, rows, nullptr, tuning, scratch);
+	}
+	else {
+		_KFASTBands<nonmax_suppression>(data, cols, rows, stride, keypoints, threshold, executor, tuning, band_kps, scratch, bands);
+		for (int32_t j = 0; j < bands; ++j) _KFASTOutput<Keypoints>::append(keypoints, band_kps[j]);
+	}
+	_KFASTOutput<Keypoints>::finish(keypoints, cols, rows);
+}
+
+// Output written straight into out[0, capacity); keypoints past 'capacity'
+// are only counted.
+template <typename KeypointT>
+struct _KFASTSpan {
+	KeypointT* out;
+	size_t capacity;
+	size_t count;
+
+	void clear() { count = 0; }
+	void reserve(size_t) {}
+
+	void emplace_back(const int32_t x, const int32_t y, const uint8_t score) {
+		if (count < capacity) out[count] = KeypointT(x, y, score);
+		++count;
+	}
+};
+
+template <typename KeypointT>
+struct _KFASTOutput<_KFASTSpan<KeypointT>> {
+	static constexpr bool scores = false;
+};
+
+// Two passes over the bands of a span. In the first, band 0 writes straight
+// into 'out', since it always starts at out[0], and the others only count,
+// into counts[k]. Once the counts are turned into offsets, the second pass
+// detects band k + 1 again straight into out + counts[k + 1].
+template <const bool nonmax_suppression, typename KeypointT>
+struct _KFASTSpanJob {
+	const uint8_t* data;
+	int32_t cols;
+	int32_t rows;
+	int32_t stride;
+	int32_t bands;
+	uint8_t threshold;
+	KeypointT* out;
+	size_t capacity;
+	size_t* counts;
+	const KFASTTuning* tuning;
+	KFASTScratch* scratch;
+
+	static void count(void* const arg, const int32_t k) {
+		const _KFASTSpanJob& job = *static_cast<const _KFASTSpanJob*>(arg);
+		_KFASTSpan<KeypointT> span = { k ? nullptr : job.out, k ? 0 : job.capacity, 0 };
+		detect(job, span, k);
+		job.counts[k] = span.count;
+	}
+
+	static void place(void* const arg, const int32_t k) {
+		const _KFASTSpanJob& job = *static_cast<const _KFASTSpanJob*>(arg);
+		const size_t begin = job.counts[k + 1];
+		_KFASTSpan<KeypointT> span = { job.out + begin, job.capacity - begin, 0 };
+		detect(job, span, k + 1);
+	}
+
+	static void detect(const _KFASTSpanJob& job, _KFASTSpan<KeypointT>& span, const int32_t k) {
+		_KFASTBand<nonmax_suppression>(job.data, job.cols, job.rows, job.stride, span, job.threshold,
+			KFASTBandRow(job.rows, job.bands, k), KFASTBandRow(job.rows, job.bands, k + 1), nullptr, *job.tuning,
+			job.scratch ? job.scratch + k : nullptr);
+	}
+};
+
+// Body of the span forms of KFAST and KFASTDetector::detect. A single band
+// writes straight into 'out'. With several, the first band does too while the
+// others count, and then the bands that start within 'capacity' detect again
+// straight into place. 'counts' is grown to the number of bands as needed.
+template <const bool multithreading, const bool nonmax_suppression, typename KeypointT>
+size_t _KFASTRunInto(const uint8_t* __restrict const data, const int32_t cols, const int32_t rows, const int32_t stride,
+	KeypointT* const out, const size_t capacity, const uint8_t threshold, KFASTExecutor& executor, const KFASTTuning& tuning,
+	std::vector<size_t>& counts, KFASTScratch* const scratch) {
+	const int32_t bands = multithreading ? std::max(std::min(rows >> 4, executor.concurrency()), 1) : 1;
+	if (bands <= 1) {
+		_KFASTSpan<KeypointT> span = { out, capacity, 0 };
+		_KFASTBand<nonmax_suppression>(data, cols, rows, stride, span, threshold, 0, rows, nullptr, tuning, scratch);
+		return span.count;
+	}
+
+	if (static_cast<int32_t>(counts.size()) < bands) counts.resize(bands);
+	_KFASTSpanJob<nonmax_suppression, KeypointT> job = { data, cols, rows, stride, bands, threshold, out, capacity, counts.data(), &tuning, scratch };
+	executor.run(bands, &_KFASTSpanJob<nonmax_suppression, KeypointT>::count, &job);
+
+	// counts to offsets; bands starting at or past 'capacity' have nothing to write
+	size_t total = 0;
+	int32_t placed = 1;
+	for (int32_t k = 0; k < bands; ++k) {
+		const size_t n = counts[k];
+		counts[k] = total;
+		total += n;
+		if (k && counts[k] < capacity) placed = k + 1;
+	}
+	if (placed > 1) executor.run(placed - 1, &_KFASTSpanJob<nonmax_suppression, KeypointT>::place, &job);
+	return total;
+}
+
+// 'keypoints' is a std::vector of Keypoint or KFASTCompactKeypoint,
+// a KFASTKeypointsSoA, a KFASTKeypointsCSR, a KFASTCornerMask, a KFASTScoreMap,
+// a KFASTSink, a KFASTOrdered or a KFASTScoreSorted.
+// A vector may use any allocator, e.g. KFASTArenaAllocator or (C++17)
+// std::pmr::polymorphic_allocator; the per-band vectors use the same one.
+// With multithreading the bands allocate from the executor's threads,
+// so the allocator must be thread-safe: KFASTArena is, but
+// std::pmr::monotonic_buffer_resource is not.
+template <const bool multithreading, const bool nonmax_suppression, typename Keypoints>
 void KFAST(const uint8_t* __restrict const data, const int32_t cols, const int32_t rows, const int32_t stride,
-        std::vector<Keypoint>& keypoints, const uint8_t threshold) {
-        if (multithreading) {
-                const int32_t hw_concur = std::min(rows >> 4, static_cast<int32_t>(std::thread::hardware_concurrency()));
-                std::vector<std::vector<Keypoint>> thread_kps(hw_concur);
-                std::vector<std::future<void>> fut(hw_concur);
-
-                if (hw_concur <= 1) {
-                        keypoints.clear();
-                        keypoints.reserve(8500);
-                        _KFAST<nonmax_suppression, true, true>(data, cols, 0, rows, stride, keypoints, threshold);
-                }
-                else {
-                        int row = (rows - 1) / hw_concur + 1;
-                        fut[0] = std::async(std::launch::async, _KFAST<nonmax_suppression, true, false>, data, cols, 0, row + (3 + nonmax_suppression), stride, std::ref(thread_kps[0]), threshold);
-                        int i = 1;
-                        for (; i < hw_concur - 1; ++i) {
-                                const int start_row = row - (3 + nonmax_suppression);
-                                const int delta = (rows - row - 1) / (hw_concur - i) + 1;
-                                fut[i] = std::async(std::launch::async, _KFAST<nonmax_suppression, false, false>, data + start_row*stride, cols, start_row, delta + ((3 + nonmax_suppression) << 1), stride, std::ref(thread_kps[i]), threshold);
-                                row += delta;
-                        }
-                        int start_row = row - (3 + nonmax_suppression);
-                        fut[i] = std::async(std::launch::async, _KFAST<nonmax_suppression, false, true>, data + start_row*stride, cols, start_row, rows - start_row, stride, std::ref(thread_kps[i]), threshold);
-                        keypoints.clear();
-                        keypoints.reserve(8500);
-                        for (int j = 0; j <= i; ++j) {
-                                fut[j].wait();
-                                keypoints.insert(keypoints.end(), thread_kps[j].begin(), thread_kps[j].end());
-                        }
-                }
-        }
-        else {
-                keypoints.clear();
-                keypoints.reserve(8500);
-                _KFAST<nonmax_suppression, true, true>(data, cols, 0, rows, stride, keypoints, threshold);
-        }
+	Keypoints& keypoints, const uint8_t threshold, KFASTExecutor& executor, const KFASTTuning& tuning = KFASTTuning()) {
+	typedef _KFASTOutput<Keypoints> Output;
+	std::vector<typename Output::Band, typename Output::BandAlloc> band_kps{ Output::bandAlloc(keypoints) };
+	_KFASTRun<multithreading, nonmax_suppression>(data, cols, rows, stride, keypoints, threshold, executor, tuning, band_kps, nullptr);
+}
+
+// multithreaded calls without an explicit executor share KFASTDefaultPool()
+template <const bool multithreading, const bool nonmax_suppression, typename Keypoints>
+void KFAST(const uint8_t* __restrict const data, const int32_t cols, const int32_t rows, const int32_t stride,
+	Keypoints& keypoints, const uint8_t threshold) {
+	KFASTInlineExecutor inline_executor;
+	KFAST<multithreading, nonmax_suppression>(data, cols, rows, stride, keypoints, threshold,
+		multithreading ? static_cast<KFASTExecutor&>(KFASTDefaultPool()) : inline_executor);
+}
+
+// Writes the keypoints straight into out[0, capacity), in the same raster order
+// as the vector form. The bands below the first count their keypoints, then
+// detect again straight into place, so there's no staging and no serial
+// gather. Returns the number of
+// keypoints found; if that's more than 'capacity', only the first 'capacity'
+// were written (nothing is ever reallocated), and the caller can retry with
+// a larger buffer.
+template <const bool multithreading, const bool nonmax_suppression, typename KeypointT>
+size_t KFAST(const uint8_t* __restrict const data, const int32_t cols, const int32_t rows, const int32_t stride,
+	KeypointT* const out, const size_t capacity, const uint8_t threshold, KFASTExecutor& executor, const KFASTTuning& tuning = KFASTTuning()) {
+	// per thread, so repeated calls don't allocate
+	static thread_local std::vector<size_t> counts;
+	return _KFASTRunInto<multithreading, nonmax_suppression>(data, cols, rows, stride, out, capacity, threshold, executor, tuning, counts, nullptr);
+}
+
+template <const bool multithreading, const bool nonmax_suppression, typename KeypointT>
+size_t KFAST(const uint8_t* __restrict const data, const int32_t cols, const int32_t rows, const int32_t stride,
+	KeypointT* const out, const size_t capacity, const uint8_t threshold) {
+	KFASTInlineExecutor inline_executor;
+	return KFAST<multithreading, nonmax_suppression>(data, cols, rows, stride, out, capacity, threshold,
+		multithreading ? static_cast<KFASTExecutor&>(KFASTDefaultPool()) : inline_executor);
+}
+
+// How one frame's keypoints differ from the previous frame's. Each list is
+// in raster order (so each can go through KFASTEncode as is):
+// 'added' are at positions the previous frame had no keypoint at,
+// 'removed' are previous keypoints with no keypoint at their position now,
+// and 'changed' are at the same position with a new score.
+template <typename KeypointT = Keypoint>
+struct KFASTDelta {
+	std::vector<KeypointT> added;
+	std::vector<KeypointT> removed;
+	std::vector<KeypointT> changed;
+
+	void clear() {
+		added.clear();
+		removed.clear();
+		changed.clear();
+	}
+
+	// number of entries in all three lists
+	size_t size() const { return added.size() + removed.size() + changed.size(); }
+	bool empty() const { return !size(); }
+};
+
+template <typename KeypointT>
+inline bool _KFASTRasterBefore(const KeypointT& a, const KeypointT& b) {
+	return a.y < b.y || (a.y == b.y && a.x < b.x);
 }
 
+// Sets 'delta' to the changes from 'prev' to 'cur', both in raster order,
+// by a single linear merge of the two.
+template <typename KeypointT>
+void KFASTDiff(const std::vector<KeypointT>& prev, const std::vector<KeypointT>& cur, KFASTDelta<KeypointT>& delta) {
+	delta.clear();
+	size_t i = 0, j = 0;
+	while (i < prev.size() && j < cur.size()) {
+		if (_KFASTRasterBefore(prev[i], cur[j])) {
+			delta.removed.push_back(prev[i++]);
+		}
+		else if (_KFASTRasterBefore(cur[j], prev[i])) {
+			delta.added.push_back(cur[j++]);
+		}
+		else {
+			if (prev[i].score != cur[j].score) delta.changed.push_back(cur[j]);
+			++i;
+			++j;
+		}
+	}
+	delta.removed.insert(delta.removed.end(), prev.begin() + i, prev.end());
+	delta.added.insert(delta.added.end(), cur.begin() + j, cur.end());
+}
+
+// Rebuilds the current keypoints in 'cur' from the previous ones and the
+// delta between them, e.g. on the receiving end of a stream of deltas.
+template <typename KeypointT>
+void KFASTApply(const std::vector<KeypointT>& prev, const KFASTDelta<KeypointT>& delta, std::vector<KeypointT>& cur) {
+	cur.clear();
+	cur.reserve(prev.size() + delta.added.size());
+	size_t a = 0, r = 0, c = 0;
+	for (const KeypointT& kp : prev) {
+		while (a < delta.added.size() && _KFASTRasterBefore(delta.added[a], kp)) cur.push_back(delta.added[a++]);
+		if (r < delta.removed.size() && !_KFASTRasterBefore(delta.removed[r], kp) && !_KFASTRasterBefore(kp, delta.removed[r])) {
+			++r;
+		}
+		else if (c < delta.changed.size() && !_KFASTRasterBefore(delta.changed[c], kp) && !_KFASTRasterBefore(kp, delta.changed[c])) {
+			cur.push_back(delta.changed[c++]);
+		}
+		else {
+			cur.push_back(kp);
+		}
+	}
+	cur.insert(cur.end(), delta.added.begin() + a, delta.added.end());
+}
+
+// Reusable detector context for calling KFAST over and over, e.g. once per frame.
+//
+// Owns the output vectors and per-band scratch (NMS buffers, re-pitch copies,
+// column-strip staging), all grown to fit the largest image seen so far,
+// and optionally its own worker pool. Once warmed up on a given image size,
+// detect() makes no heap allocations at all.
+// Keypoints are Keypoint or, e.g., KFASTCompactKeypoint.
+template <const bool multithreading, const bool nonmax_suppression, typename KeypointT = Keypoint>
+class KFASTDetector {
+public:
+	// detects on 'executor', or on KFASTDefaultPool() if none is given
+	explicit KFASTDetector(KFASTExecutor* const _executor = nullptr, const KFASTTuning& _tuning = KFASTTuning()) :
+		tuning(_tuning), executor(_executor) {
+		if (!executor) executor = multithreading ? static_cast<KFASTExecutor*>(&KFASTDefaultPool()) : &inline_executor;
+		init();
+	}
+
+	// detects on a KFASTPool of its own
+	KFASTDetector(const int32_t threads, const std::chrono::nanoseconds spin, const KFASTTuning& _tuning = KFASTTuning()) :
+		tuning(_tuning), pool(new KFASTPool(threads, spin)), executor(pool.get()) {
+		init();
+	}
+
+	KFASTDetector(const KFASTDetector&) = delete;
+	KFASTDetector& operator=(const KFASTDetector&) = delete;
+
+	// Returns the keypoints, which stay valid until the next call.
+	const std::vector<KeypointT>& detect(const uint8_t* __restrict const data, const int32_t cols, const int32_t rows, const int32_t stride,
+		const uint8_t threshold) {
+		_KFASTRun<multithreading, nonmax_suppression>(data, cols, rows, stride, kps, threshold, *executor, tuning, band_kps, scratch.data());
+		return kps;
+	}
+
+	// As above, and sets 'delta' to the changes from the keypoints of the previous
+	// call that returned them (on the first call, every keypoint is added).
+	// The previous keypoints are kept by swapping buffers, so this doesn't
+	// allocate in steady state either once 'delta' has grown to fit.
+	const std::vector<KeypointT>& detect(const uint8_t* __restrict const data, const int32_t cols, const int32_t rows, const int32_t stride,
+		const uint8_t threshold, KFASTDelta<KeypointT>& delta) {
+		prev.swap(kps);
+		detect(data, cols, rows, stride, threshold);
+		KFASTDiff(prev, kps, delta);
+		return kps;
+	}
+
+	// Writes the keypoints into out[0, capacity) instead; see the span form of KFAST.
+	// They're also copied to keypoints(), and become the previous keypoints of
+	// the next delta call, so mixing the forms keeps both up to date. Keypoints
+	// past 'capacity' aren't kept anywhere.
+	size_t detect(const uint8_t* __restrict const data, const int32_t cols, const int32_t rows, const int32_t stride,
+		KeypointT* const out, const size_t capacity, const uint8_t threshold) {
+		const size_t count = _KFASTRunInto<multithreading, nonmax_suppression>(data, cols, rows, stride, out, capacity, threshold, *executor, tuning,
+			band_counts, scratch.data());
+		kps.assign(out, out + std::min(count, capacity));
+		return count;
+	}
+
+	const std::vector<KeypointT>& keypoints() const { return kps; }
+
+	// number of times any scratch buffer has had to grow
+	uint64_t allocations() const {
+		uint64_t ret = 0;
+		for (const KFASTScratch& s : scratch) ret += s.allocations();
+		return ret;
+	}
+
+	KFASTTuning tuning;
+
+private:
+	void init() {
+		const int32_t bands = std::max(executor->concurrency(), 1);
+		scratch.resize(bands);
+		band_kps.resize(bands);
+		band_counts.resize(bands);
+	}
+
+	std::unique_ptr<KFASTPool> pool;
+	KFASTInlineExecutor inline_executor;
+	KFASTExecutor* executor;
+	std::vector<KFASTScratch> scratch;
+	std::vector<std::vector<KeypointT>> band_kps;
+	std::vector<size_t> band_counts;
+	std::vector<KeypointT> kps;
+	std::vector<KeypointT> prev;
+};
+
+// Order in which KFASTAnytime visits row chunks.
+enum class KFASTChunkOrder {
+	// top to bottom
+	Raster,
+
+	// nearest the vertical center of the image first
+	CenterOut,
+
+	// caller-supplied list of chunk indices, most important first;
+	// chunks not listed are never visited
+	Ranked
+};
+
+// How much of the image a KFASTAnytime call covered before its deadline.
+struct KFASTCoverage {
+	int32_t chunks;
+	int32_t chunks_done;
+	int32_t rows_done;
+	float fraction;
+
+	// one entry per chunk, top to bottom: 1 if the chunk was fully detected
+	std::vector<uint8_t> chunk_done;
+};
+
+template <const bool nonmax_suppression>
+struct _KFASTAnytimeJob {
+	const uint8_t* data;
+	int32_t cols;
+	int32_t rows;
+	int32_t stride;
+	int32_t chunks;
+	uint8_t threshold;
+	std::chrono::steady_clock::time_point deadline;
+	const int32_t* order;
+	int32_t num_order;
+	std::atomic<int32_t> next;
+	std::vector<Keypoint>* chunk_kps;
+	uint8_t* chunk_done;
+
+	static void run(void* const arg, int32_t) {
+		_KFASTAnytimeJob& job = *static_cast<_KFASTAnytimeJob*>(arg);
+		int32_t p;
+		while ((p = job.next.fetch_add(1, std::memory_order_relaxed)) < job.num_order && std::chrono::steady_clock::now() <= job.deadline) {
+			const int32_t c = job.order[p];
+			job.chunk_done[c] = _KFASTBand<nonmax_suppression>(job.data, job.cols, job.rows, job.stride, job.chunk_kps[c], job.threshold,
+				KFASTBandRow(job.rows, job.chunks, c), KFASTBandRow(job.rows, job.chunks, c + 1), &job.deadline);
+		}
+	}
+};
+
+// Deadline-bounded ("anytime") KFAST.
+//
+// The image is split into chunks of about 'chunk_rows' rows, which are
+// detected in the given priority order until 'deadline'. Once it passes,
+// no new chunks are started and chunks in progress are abandoned,
+// so the call overruns the deadline by at most a few rows' work.
+// 'keypoints' receives the keypoints of every completed chunk, in raster
+// order, and the returned coverage says which chunks those were.
+// With 'order' == Ranked, 'ranking' lists chunk indices (0 is the top chunk)
+// in the order to visit them.
+template <const bool multithreading, const bool nonmax_suppression>
+KFASTCoverage KFASTAnytime(const uint8_t* __restrict const data, const int32_t cols, const int32_t rows, const int32_t stride,
+	std::vector<Keypoint>& keypoints, const uint8_t threshold, const std::chrono::steady_clock::time_point deadline,
+	const KFASTChunkOrder order, const std::vector<int32_t>& ranking, const int32_t chunk_rows, KFASTExecutor& executor) {
+	KFASTCoverage coverage;
+	coverage.chunks = std::max(rows / std::max(chunk_rows, 16), 1);
+	coverage.chunk_done.assign(coverage.chunks, 0);
+
+	std::vector<int32_t> visit;
+	if (order == KFASTChunkOrder::Ranked) {
+		for (const int32_t c : ranking) {
+			if (c >= 0 && c < coverage.chunks) visit.push_back(c);
+		}
+	}
+	else {
+		for (int32_t c = 0; c < coverage.chunks; ++c) visit.push_back(c);
+		if (order == KFASTChunkOrder::CenterOut) {
+			const int32_t chunks = coverage.chunks;
+			std::stable_sort(visit.begin(), visit.end(), [rows, chunks](const int32_t a, const int32_t b) {
+				return std::abs(KFASTBandRow(rows, chunks, a) + KFASTBandRow(rows, chunks, a + 1) - rows) <
+					std::abs(KFASTBandRow(rows, chunks, b) + KFASTBandRow(rows, chunks, b + 1) - rows);
+			});
+		}
+	}
+
+	std::vector<std::vector<Keypoint>> chunk_kps(coverage.chunks);
+	_KFASTAnytimeJob<nonmax_suppression> job;
+	job.data = data;
+	job.cols = cols;
+	job.rows = rows;
+	job.stride = stride;
+	job.chunks = coverage.chunks;
+	job.threshold = threshold;
+	job.deadline = deadline;
+	job.order = visit.data();
+	job.num_order = static_cast<int32_t>(visit.size());
+	job.next.store(0, std::memory_order_relaxed);
+	job.chunk_kps = chunk_kps.data();
+	job.chunk_done = coverage.chunk_done.data();
+
+	const int32_t tasks = multithreading ? std::min(executor.concurrency(), std::max(job.num_order, 1)) : 1;
+	if (tasks > 1) executor.run(tasks, &_KFASTAnytimeJob<nonmax_suppression>::run, &job);
+	else _KFASTAnytimeJob<nonmax_suppression>::run(&job, 0);
+
+	keypoints.clear();
+	coverage.chunks_done = coverage.rows_done = 0;
+	for (int32_t c = 0; c < coverage.chunks; ++c) {
+		if (!coverage.chunk_done[c]) continue;
+		++coverage.chunks_done;
+		coverage.rows_done += KFASTBandRow(rows, coverage.chunks, c + 1) - KFASTBandRow(rows, coverage.chunks, c);
+		keypoints.insert(keypoints.end(), chunk_kps[c].begin(), chunk_kps[c].end());
+	}
+	coverage.fraction = static_cast<float>(coverage.rows_done) / static_cast<float>(std::max(rows, 1));
+	return coverage;
+}
+
+// multithreaded calls without an explicit executor share KFASTDefaultPool()
+template <const bool multithreading, const bool nonmax_suppression>
+KFASTCoverage KFASTAnytime(const uint8_t* __restrict const data, const int32_t cols, const int32_t rows, const int32_t stride,
+	std::vector<Keypoint>& keypoints, const uint8_t threshold, const std::chrono::steady_clock::time_point deadline,
+	const KFASTChunkOrder order = KFASTChunkOrder::CenterOut, const std::vector<int32_t>& ranking = std::vector<int32_t>(),
+	const int32_t chunk_rows = 32) {
+	KFASTInlineExecutor inline_executor;
+	return KFASTAnytime<multithreading, nonmax_suppression>(data, cols, rows, stride, keypoints, threshold, deadline, order, ranking, chunk_rows,
+		multithreading ? static_cast<KFASTExecutor&>(KFASTDefaultPool()) : inline_executor);
+}
+
+template <const bool nonmax_suppression>
+struct _KFASTProgressiveJob {
+	typedef std::function<void(std::vector<Keypoint>&, int32_t, int32_t)> Callback;
+
+	const uint8_t* data;
+	int32_t cols;
+	int32_t rows;
+	int32_t stride;
+	int32_t chunks;
+	uint8_t threshold;
+	const KFASTTuning* tuning;
+	const Callback* on_chunk;
+	std::atomic<int32_t> next;
+	std::vector<Keypoint>* chunk_kps;
+	KFASTScratch* scratch;
+
+	// guarded by mtx
+	std::mutex mtx;
+	uint8_t* chunk_done;
+	int32_t delivered;
+	bool delivering;
+
+	static void run(void* const arg, const int32_t k) {
+		_KFASTProgressiveJob& job = *static_cast<_KFASTProgressiveJob*>(arg);
+		int32_t c;
+		while ((c = job.next.fetch_add(1, std::memory_order_relaxed)) < job.chunks) {
+			_KFASTBand<nonmax_suppression>(job.data, job.cols, job.rows, job.stride, job.chunk_kps[c], job.threshold,
+				KFASTBandRow(job.rows, job.chunks, c), KFASTBandRow(job.rows, job.chunks, c + 1), nullptr, *job.tuning, job.scratch + k);
+
+			// whoever completes the next undelivered chunk delivers it and any
+			// finished chunks after it, one thread at a time, outside the lock
+			std::unique_lock<std::mutex> lock(job.mtx);
+			job.chunk_done[c] = 1;
+			if (job.delivering) continue;
+			job.delivering = true;
+			while (job.delivered < job.chunks && job.chunk_done[job.delivered]) {
+				const int32_t d = job.delivered;
+				lock.unlock();
+				(*job.on_chunk)(job.chunk_kps[d], KFASTBandRow(job.rows, job.chunks, d), KFASTBandRow(job.rows, job.chunks, d + 1));
+				lock.lock();
+				++job.delivered;
+			}
+			job.delivering = false;
+		}
+	}
+};
+
+// Progressive KFAST, for consuming keypoints while the rest of the frame
+// is still being detected.
+//
+// The image is split into chunks of about 'chunk_rows' rows, which are
+// detected top to bottom. As soon as a chunk and every chunk above it are
+// done, 'on_chunk' is called with the chunk's keypoints (in raster order)
+// and its rows [begin_row, end_row). Calls are made one at a time and
+// strictly top to bottom, from whichever thread finished the chunk, so the
+// callback needs no locking of its own but should be quick: while it runs,
+// later chunks are still detected but not delivered. Concatenated, the
+// chunks are exactly the output of KFAST. Returns once every chunk has been
+// delivered.
+template <const bool multithreading, const bool nonmax_suppression>
+void KFASTProgressive(const uint8_t* __restrict const data, const int32_t cols, const int32_t rows, const int32_t stride,
+	const uint8_t threshold, std::function<void(std::vector<Keypoint>&, int32_t, int32_t)> on_chunk,
+	const int32_t chunk_rows, KFASTExecutor& executor, const KFASTTuning& tuning = KFASTTuning()) {
+	const int32_t chunks = std::max(rows / std::max(chunk_rows, 16), 1);
+	const int32_t tasks = multithreading ? std::min(executor.concurrency(), chunks) : 1;
+	std::vector<std::vector<Keypoint>> chunk_kps(chunks);
+	std::vector<uint8_t> chunk_done(chunks, 0);
+	std::vector<KFASTScratch> scratch(std::max(tasks, 1));
+
+	_KFASTProgressiveJob<nonmax_suppression> job;
+	job.data = data;
+	job.cols = cols;
+	job.rows = rows;
+	job.stride = stride;
+	job.chunks = chunks;
+	job.threshold = threshold;
+	job.tuning = &tuning;
+	job.on_chunk = &on_chunk;
+	job.next.store(0, std::memory_order_relaxed);
+	job.chunk_kps = chunk_kps.data();
+	job.scratch = scratch.data();
+	job.chunk_done = chunk_done.data();
+	job.delivered = 0;
+	job.delivering = false;
+
+	if (tasks > 1) executor.run(tasks, &_KFASTProgressiveJob<nonmax_suppression>::run, &job);
+	else _KFASTProgressiveJob<nonmax_suppression>::run(&job, 0);
+}
+
+// multithreaded calls without an explicit executor share KFASTDefaultPool()
+template <const bool multithreading, const bool nonmax_suppression>
+void KFASTProgressive(const uint8_t* __restrict const data, const int32_t cols, const int32_t rows, const int32_t stride,
+	const uint8_t threshold, std::function<void(std::vector<Keypoint>&, int32_t, int32_t)> on_chunk, const int32_t chunk_rows = 64) {
+	KFASTInlineExecutor inline_executor;
+	KFASTProgressive<multithreading, nonmax_suppression>(data, cols, rows, stride, threshold, std::move(on_chunk), chunk_rows,
+		multithreading ? static_cast<KFASTExecutor&>(KFASTDefaultPool()) : inline_executor);
+}
+
+// Background thread that runs posted jobs one at a time, in order.
+// Drives KFASTAsync so the caller never blocks on detection.
+class KFASTDispatcher {
+public:
+	KFASTDispatcher() : thread(&KFASTDispatcher::loop, this) {}
+
+	KFASTDispatcher(const KFASTDispatcher&) = delete;
+	KFASTDispatcher& operator=(const KFASTDispatcher&) = delete;
+
+	// runs all posted jobs before returning
+	~KFASTDispatcher() {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stop = true;
+		}
+		cv.notify_one();
+		thread.join();
+	}
+
+	void post(std::function<void()> job) {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			jobs.push_back(std::move(job));
+		}
+		cv.notify_one();
+	}
+
+private:
+	void loop() {
+		for (;;) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				cv.wait(lock, [this] { return stop || !jobs.empty(); });
+				if (jobs.empty()) return;
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+			job();
+		}
+	}
+
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::deque<std::function<void()>> jobs;
+	bool stop = false;
+	std::thread thread;
+};
+
+inline KFASTDispatcher& KFASTDefaultDispatcher() {
+	static KFASTDispatcher dispatcher;
+	return dispatcher;
+}
+
+// Asynchronous KFAST. Returns immediately; detection runs on 'dispatcher'
+// (using 'executor' for the bands, as in KFAST<multithreading, ...>)
+// and then 'done' is called on the dispatcher thread with 'keypoints'.
+// Calls on the same dispatcher complete in submission order.
+//
+// Lifetime: 'data' must stay valid and unmodified, and 'keypoints'
+// must stay valid and untouched, until 'done' has been called.
+template <const bool multithreading, const bool nonmax_suppression>
+void KFASTAsync(const uint8_t* const data, const int32_t cols, const int32_t rows, const int32_t stride,
+	std::vector<Keypoint>& keypoints, const uint8_t threshold, std::function<void(std::vector<Keypoint>&)> done,
+	KFASTExecutor& executor, KFASTDispatcher& dispatcher = KFASTDefaultDispatcher()) {
+	std::vector<Keypoint>* const kps = &keypoints;
+	KFASTExecutor* const exec = &executor;
+	dispatcher.post([=] {
+		KFAST<multithreading, nonmax_suppression>(data, cols, rows, stride, *kps, threshold, *exec);
+		done(*kps);
+	});
+}
+
+// Multithreaded calls without an explicit executor share KFASTDefaultPool(),
+// constructed before KFASTDefaultDispatcher() so that it outlives any jobs
+// still draining when the dispatcher is destroyed at exit.
+template <const bool multithreading, const bool nonmax_suppression>
+void KFASTAsync(const uint8_t* const data, const int32_t cols, const int32_t rows, const int32_t stride,
+	std::vector<Keypoint>& keypoints, const uint8_t threshold, std::function<void(std::vector<Keypoint>&)> done) {
+	// stateless, so one can serve every queued job
+	static KFASTInlineExecutor inline_executor;
+	KFASTExecutor& executor = multithreading ? static_cast<KFASTExecutor&>(KFASTDefaultPool()) : inline_executor;
+	KFASTAsync<multithreading, nonmax_suppression>(data, cols, rows, stride, keypoints, threshold, std::move(done), executor, KFASTDefaultDispatcher());
+}
+
+// As above, but returns a future that becomes ready once 'keypoints' is filled.
+// The same lifetime rules apply until the future is ready.
+template <const bool multithreading, const bool nonmax_suppression>
+std::future<void> KFASTAsync(const uint8_t* const data, const int32_t cols, const int32_t rows, const int32_t stride,
+	std::vector<Keypoint>& keypoints, const uint8_t threshold,
+	KFASTExecutor& executor, KFASTDispatcher& dispatcher = KFASTDefaultDispatcher()) {
+	std::shared_ptr<std::promise<void>> promise = std::make_shared<std::promise<void>>();
+	std::future<void> ret = promise->get_future();
+	KFASTAsync<multithreading, nonmax_suppression>(data, cols, rows, stride, keypoints, threshold,
+		[promise](std::vector<Keypoint>&) { promise->set_value(); }, executor, dispatcher);
+	return ret;
+}
+
+template <const bool multithreading, const bool nonmax_suppression>
+std::future<void> KFASTAsync(const uint8_t* const data, const int32_t cols, const int32_t rows, const int32_t stride,
+	std::vector<Keypoint>& keypoints, const uint8_t threshold) {
+	std::shared_ptr<std::promise<void>> promise = std::make_shared<std::promise<void>>();
+	std::future<void> ret = promise->get_future();
+	KFASTAsync<multithreading, nonmax_suppression>(data, cols, rows, stride, keypoints, threshold,
+		[promise](std::vector<Keypoint>&) { promise->set_value(); });
+	return ret;
+}
+
+// Video-mode scheduler.
+//
+// Frames are submitted to a queue and detected on the scheduler's own
+// workers using one of two strategies, chosen per frame as it is dequeued:
+//
+// - frame-parallel: one worker detects the whole frame. No halos and no merge,
+//   so this gives the best throughput once every worker has a frame to chew on.
+// - intra-frame: the frame is split into bands that all idle workers pick up,
+//   as in KFAST<true, ...>. This gives the lowest latency per frame.
+//
+// A frame is split only if a single worker is expected to miss 'latency_target'
+// on it (based on a running estimate of single-core cost per pixel) AND fewer
+// frames are queued than there are workers, i.e. there are idle cores to help.
+// A latency_target of 0 therefore splits whenever cores are idle (live streams),
+// and a very large one never splits (offline processing).
+//
+// 'on_frame' is called on a worker thread with the sequence number returned by
+// submit() and the frame's keypoints, in raster order. Frames can complete
+// out of order. The image passed to submit() must stay valid until its
+// callback has run.
+template <const bool nonmax_suppression>
+class KFASTVideo {
+public:
+	typedef std::function<void(uint64_t, std::vector<Keypoint>&)> Callback;
+
+	KFASTVideo(Callback _on_frame, const std::chrono::nanoseconds _latency_target,
+		const int32_t threads = static_cast<int32_t>(std::thread::hardware_concurrency())) :
+		on_frame(std::move(_on_frame)), latency_target(_latency_target) {
+		for (int32_t k = 0; k < std::max(threads, 1); ++k) workers.emplace_back(&KFASTVideo::worker, this);
+	}
+
+	KFASTVideo(const KFASTVideo&) = delete;
+	KFASTVideo& operator=(const KFASTVideo&) = delete;
+
+	// finishes all submitted frames before returning
+	~KFASTVideo() {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stop = true;
+		}
+		work.notify_all();
+		for (std::thread& w : workers) w.join();
+	}
+
+	uint64_t submit(const uint8_t* const data, const int32_t cols, const int32_t rows, const int32_t stride, const uint8_t threshold) {
+		std::shared_ptr<Frame> frame = std::make_shared<Frame>();
+		frame->data = data;
+		frame->cols = cols;
+		frame->rows = rows;
+		frame->stride = stride;
+		frame->threshold = threshold;
+		uint64_t seq;
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			seq = frame->seq = submitted++;
+			queue.push_back(std::move(frame));
+		}
+		work.notify_one();
+		return seq;
+	}
+
+	// blocks until every frame submitted so far has been delivered
+	void flush() {
+		std::unique_lock<std::mutex> lock(mtx);
+		const uint64_t target = submitted;
+		idle.wait(lock, [this, target] { return delivered >= target; });
+	}
+
+	// how many frames each strategy has handled so far
+	uint64_t splitFrames() const { return split_frames.load(std::memory_order_relaxed); }
+	uint64_t wholeFrames() const { return whole_frames.load(std::memory_order_relaxed); }
+
+private:
+	struct Frame {
+		uint64_t seq;
+		const uint8_t* data;
+		int32_t cols;
+		int32_t rows;
+		int32_t stride;
+		uint8_t threshold;
+		int32_t bands = 1;
+		int32_t next_band = 0;
+		std::atomic<int32_t> remaining{ 1 };
+		std::atomic<int64_t> cpu_ns{ 0 };
+		std::vector<std::vector<Keypoint>> band_kps;
+	};
+
+	void worker() {
+		for (;;) {
+			std::shared_ptr<Frame> frame;
+			int32_t band;
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				work.wait(lock, [this] { return stop || split || !queue.empty(); });
+
+				// help finish a split frame before starting a new one
+				if (split) {
+					frame = split;
+				}
+				else if (!queue.empty()) {
+					frame = std::move(queue.front());
+					queue.pop_front();
+					const int32_t bands = std::min(frame->rows >> 4, static_cast<int32_t>(workers.size()));
+					const double single_ns = ns_per_px * static_cast<double>(frame->cols) * static_cast<double>(frame->rows);
+
+					// until a frame has been timed, only a zero target is sure to be missed
+					const bool misses = delivered ? single_ns > static_cast<double>(latency_target.count()) : latency_target.count() <= 0;
+					if (bands > 1 && misses && queue.size() + 1 < workers.size()) {
+						frame->bands = bands;
+						frame->remaining.store(bands, std::memory_order_relaxed);
+						split = frame;
+						work.notify_all();
+					}
+					frame->band_kps.resize(frame->bands);
+				}
+				else {
+					return;
+				}
+
+				band = frame->next_band++;
+				if (frame == split && frame->next_band == frame->bands) split.reset();
+			}
+
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			_KFASTBand<nonmax_suppression>(frame->data, frame->cols, frame->rows, frame->stride, frame->band_kps[band], frame->threshold,
+				KFASTBandRow(frame->rows, frame->bands, band), KFASTBandRow(frame->rows, frame->bands, band + 1));
+			frame->cpu_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+
+			if (frame->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) finish(*frame);
+		}
+	}
+
+	void finish(Frame& frame) {
+		std::vector<Keypoint>& keypoints = frame.band_kps[0];
+		for (int32_t j = 1; j < frame.bands; ++j) keypoints.insert(keypoints.end(), frame.band_kps[j].begin(), frame.band_kps[j].end());
+		(frame.bands > 1 ? split_frames : whole_frames).fetch_add(1, std::memory_order_relaxed);
+		on_frame(frame.seq, keypoints);
+
+		std::lock_guard<std::mutex> lock(mtx);
+		const double px_ns = static_cast<double>(frame.cpu_ns.load(std::memory_order_relaxed)) / (static_cast<double>(frame.cols) * static_cast<double>(frame.rows));
+		ns_per_px = delivered ? 0.875 * ns_per_px + 0.125 * px_ns : px_ns;
+		++delivered;
+		idle.notify_all();
+	}
+
+	Callback on_frame;
+	const std::chrono::nanoseconds latency_target;
+	std::vector<std::thread> workers;
+	std::mutex mtx;
+	std::condition_variable work;
+	std::condition_variable idle;
+	std::deque<std::shared_ptr<Frame>> queue;
+	std::shared_ptr<Frame> split;
+	uint64_t submitted = 0;
+	uint64_t delivered = 0;
+	double ns_per_px = 0.0;
+	std::atomic<uint64_t> split_frames{ 0 };
+	std::atomic<uint64_t> whole_frames{ 0 };
+	bool stop = false;
+};
+
+// Multi-stream QoS scheduler.
+//
+// Many camera streams share one set of workers. Each stream has a priority
+// and each frame a deadline. Frames are split into chunks of about
+// 'chunk_rows' rows, and whenever a worker finishes a chunk it takes the next
+// chunk of the most important pending frame: highest stream priority first,
+// then earliest deadline, then submission order. A high-priority frame
+// therefore preempts lower-priority work within one chunk's time.
+//
+// A frame whose deadline passes before all of its chunks have been started is
+// dropped: its remaining chunks are skipped and it is reported with
+// dropped == true and no keypoints. Chunks already running are allowed to finish.
+//
+// 'on_frame' is called on a worker thread with the stream, the sequence number
+// returned by submit(), the keypoints in raster order, and whether the frame was
+// dropped. The image passed to submit() must stay valid until its callback has run.
+template <const bool nonmax_suppression>
+class KFASTStreams {
+public:
+	typedef std::function<void(int32_t, uint64_t, std::vector<Keypoint>&, bool)> Callback;
+
+	struct Stats {
+		uint64_t completed;
+		uint64_t dropped;
+		std::chrono::nanoseconds mean_latency;
+		std::chrono::nanoseconds max_latency;
+	};
+
+	explicit KFASTStreams(Callback _on_frame, const int32_t threads = static_cast<int32_t>(std::thread::hardware_concurrency()),
+		const int32_t _chunk_rows = 64) : on_frame(std::move(_on_frame)), chunk_rows(std::max(_chunk_rows, 16)) {
+		for (int32_t k = 0; k < std::max(threads, 1); ++k) workers.emplace_back(&KFASTStreams::worker, this);
+	}
+
+	KFASTStreams(const KFASTStreams&) = delete;
+	KFASTStreams& operator=(const KFASTStreams&) = delete;
+
+	// finishes (or drops) all submitted frames before returning
+	~KFASTStreams() {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stop = true;
+		}
+		work.notify_all();
+		for (std::thread& w : workers) w.join();
+	}
+
+	// registers a stream; higher priorities are served first
+	int32_t addStream(const int32_t priority) {
+		std::lock_guard<std::mutex> lock(mtx);
+		streams.emplace_back();
+		streams.back().priority = priority;
+		return static_cast<int32_t>(streams.size()) - 1;
+	}
+
+	uint64_t submit(const int32_t stream, const uint8_t* const data, const int32_t cols, const int32_t rows, const int32_t stride,
+		const uint8_t threshold, const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) {
+		std::shared_ptr<Frame> frame = std::make_shared<Frame>();
+		frame->stream = stream;
+		frame->data = data;
+		frame->cols = cols;
+		frame->rows = rows;
+		frame->stride = stride;
+		frame->threshold = threshold;
+		frame->chunks = std::max(rows / chunk_rows, 1);
+		frame->remaining.store(frame->chunks, std::memory_order_relaxed);
+		frame->chunk_kps.resize(frame->chunks);
+		frame->submitted = std::chrono::steady_clock::now();
+		frame->deadline = deadline;
+		uint64_t seq;
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			frame->priority = streams[stream].priority;
+			frame->order = submitted++;
+			seq = frame->seq = streams[stream].submitted++;
+			active.push_back(std::move(frame));
+		}
+		work.notify_all();
+		return seq;
+	}
+
+	// blocks until every frame submitted so far has been delivered or dropped
+	void flush() {
+		std::unique_lock<std::mutex> lock(mtx);
+		const uint64_t target = submitted;
+		idle.wait(lock, [this, target] { return delivered >= target; });
+	}
+
+	Stats stats(const int32_t stream) const {
+		std::lock_guard<std::mutex> lock(mtx);
+		const Stream& s = streams[stream];
+		Stats ret = { s.completed, s.dropped, std::chrono::nanoseconds(s.completed ? s.total_ns / static_cast<int64_t>(s.completed) : 0),
+			std::chrono::nanoseconds(s.max_ns) };
+		return ret;
+	}
+
+private:
+	struct Stream {
+		int32_t priority = 0;
+		uint64_t submitted = 0;
+		uint64_t completed = 0;
+		uint64_t dropped = 0;
+		int64_t total_ns = 0;
+		int64_t max_ns = 0;
+	};
+
+	struct Frame {
+		int32_t stream;
+		int32_t priority;
+		uint64_t seq;
+		uint64_t order;
+		const uint8_t* data;
+		int32_t cols;
+		int32_t rows;
+		int32_t stride;
+		uint8_t threshold;
+		int32_t chunks;
+		int32_t next_chunk = 0;
+		// written under mtx; read unlocked only in finish(), which the last
+		// fetch_sub on 'remaining' (acq_rel) orders after every write
+		bool dropped = false;
+		std::atomic<int32_t> remaining{ 0 };
+		std::chrono::steady_clock::time_point submitted;
+		std::chrono::steady_clock::time_point deadline;
+		std::vector<std::vector<Keypoint>> chunk_kps;
+	};
+
+	static bool before(const Frame& a, const Frame& b) {
+		if (a.priority != b.priority) return a.priority > b.priority;
+		if (a.deadline != b.deadline) return a.deadline < b.deadline;
+		return a.order < b.order;
+	}
+
+	void worker() {
+		for (;;) {
+			std::shared_ptr<Frame> frame;
+			int32_t chunk = 0;
+			int32_t claimed = 1;
+			bool drop = false;
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				work.wait(lock, [this] { return stop || !active.empty(); });
+				if (active.empty()) return;
+
+				typename std::vector<std::shared_ptr<Frame>>::iterator best = active.begin();
+				for (typename std::vector<std::shared_ptr<Frame>>::iterator it = active.begin() + 1; it != active.end(); ++it) {
+					if (before(**it, **best)) best = it;
+				}
+				frame = *best;
+
+				if (std::chrono::steady_clock::now() > frame->deadline) {
+					// too late: give up the chunks nobody has started
+					drop = frame->dropped = true;
+					claimed = frame->chunks - frame->next_chunk;
+					frame->next_chunk = frame->chunks;
+				}
+				else {
+					chunk = frame->next_chunk++;
+				}
+				if (frame->next_chunk == frame->chunks) active.erase(best);
+			}
+
+			// decide from our own claim: another worker may drop the frame while this chunk runs
+			if (!drop) {
+				_KFASTBand<nonmax_suppression>(frame->data, frame->cols, frame->rows, frame->stride, frame->chunk_kps[chunk], frame->threshold,
+					KFASTBandRow(frame->rows, frame->chunks, chunk), KFASTBandRow(frame->rows, frame->chunks, chunk + 1));
+			}
+
+			if (frame->remaining.fetch_sub(claimed, std::memory_order_acq_rel) == claimed) finish(*frame);
+		}
+	}
+
+	void finish(Frame& frame) {
+		std::vector<Keypoint>& keypoints = frame.chunk_kps[0];
+		if (frame.dropped) {
+			keypoints.clear();
+		}
+		else {
+			for (int32_t j = 1; j < frame.chunks; ++j) keypoints.insert(keypoints.end(), frame.chunk_kps[j].begin(), frame.chunk_kps[j].end());
+		}
+		on_frame(frame.stream, frame.seq, keypoints, frame.dropped);
+
+		const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - frame.submitted).count();
+		std::lock_guard<std::mutex> lock(mtx);
+		Stream& s = streams[frame.stream];
+		if (frame.dropped) {
+			++s.dropped;
+		}
+		else {
+			++s.completed;
+			s.total_ns += ns;
+			s.max_ns = std::max(s.max_ns, ns);
+		}
+		++delivered;
+		idle.notify_all();
+	}
+
+	Callback on_frame;
+	const int32_t chunk_rows;
+	std::vector<std::thread> workers;
+	mutable std::mutex mtx;
+	std::condition_variable work;
+	std::condition_variable idle;
+	std::deque<Stream> streams;
+	std::vector<std::shared_ptr<Frame>> active;
+	uint64_t submitted = 0;
+	uint64_t delivered = 0;
+	bool stop = false;
+};
+
+// ------------- keypoint streams ------------
+//
+// Compact binary format for archiving KFAST output over many frames.
+//
+// Each frame encodes keypoints in raster order as:
+//     varint count
+//     per row with keypoints: varint rows skipped since the previous such row,
+//         varint keypoints in the row, then varint columns, each but the first
+//         as the gap to the previous column minus one
+//     count raw score bytes
+// which comes to about 2-3 bytes per keypoint. Varints are LEB128.
+//
+// A stream file is a 16-byte header ("KFASTSTR", version, reserved),
+// the frames back to back, then (8-byte aligned) a table of frames + 1
+// little-endian uint64 offsets (where each frame starts, plus where the
+// last one ends), then a 24-byte trailer: the table's offset, the number
+// of frames and "KFASTIDX". So a reader can map the file and go straight
+// to any frame.
+
+inline void _KFASTPutVarint(std::vector<uint8_t>& out, uint32_t v) {
+	while (v >= 0x80) {
+		out.push_back(static_cast<uint8_t>(v | 0x80));
+		v >>= 7;
+	}
+	out.push_back(static_cast<uint8_t>(v));
+}
+
+// reads a varint from [p, end), or returns false if it runs past 'end' or 32 bits
+inline bool _KFASTGetVarint(const uint8_t*& p, const uint8_t* const end, uint32_t& v) {
+	v = 0;
+	for (int32_t shift = 0; shift < 35 && p < end; shift += 7) {
+		const uint8_t b = *p++;
+		v |= static_cast<uint32_t>(b & 0x7F) << shift;
+		if (!(b & 0x80)) return true;
+	}
+	return false;
+}
+
+// Appends one frame of keypoints[0, count) to 'out' in the stream encoding.
+// Keypoints must be in raster order, as KFAST outputs them; returns false,
+// leaving 'out' as it was, if they aren't.
+template <typename KeypointT>
+bool KFASTEncode(const KeypointT* const keypoints, const size_t count, std::vector<uint8_t>& out) {
+	const size_t start = out.size();
+	_KFASTPutVarint(out, static_cast<uint32_t>(count));
+	int64_t prev_y = -1;
+	for (size_t i = 0; i < count;) {
+		const int64_t y = keypoints[i].y;
+		size_t end = i + 1;
+		while (end < count && keypoints[end].y == y) ++end;
+		if (y <= prev_y || keypoints[i].x < 0) {
+			out.resize(start);
+			return false;
+		}
+		_KFASTPutVarint(out, static_cast<uint32_t>(y - prev_y - 1));
+		_KFASTPutVarint(out, static_cast<uint32_t>(end - i));
+		_KFASTPutVarint(out, static_cast<uint32_t>(keypoints[i].x));
+		for (size_t k = i + 1; k < end; ++k) {
+			if (keypoints[k].x <= keypoints[k - 1].x) {
+				out.resize(start);
+				return false;
+			}
+			_KFASTPutVarint(out, static_cast<uint32_t>(keypoints[k].x - keypoints[k - 1].x - 1));
+		}
+		prev_y = y;
+		i = end;
+	}
+	for (size_t i = 0; i < count; ++i) out.push_back(keypoints[i].score);
+	return true;
+}
+
+// whether a decoded keypoint fits in 'keypoints': always, except for the fixed-size
+// images and outputs of KFASTCompactKeypoint
+template <typename Keypoints>
+inline bool _KFASTFits(const Keypoints&, int32_t, int32_t) { return true; }
+
+inline bool _KFASTFitsCompact(const int32_t x, const int32_t y) { return x <= 0xFFFF && y <= 0xFFFF; }
+
+template <typename Alloc>
+inline bool _KFASTFits(const std::vector<KFASTCompactKeypoint, Alloc>&, const int32_t x, const int32_t y) { return _KFASTFitsCompact(x, y); }
+
+inline bool _KFASTFits(const KFASTOrdered<KFASTCompactKeypoint>&, const int32_t x, const int32_t y) { return _KFASTFitsCompact(x, y); }
+
+inline bool _KFASTFits(const KFASTScoreSorted<KFASTCompactKeypoint>&, const int32_t x, const int32_t y) { return _KFASTFitsCompact(x, y); }
+
+inline bool _KFASTFits(const KFASTCornerMask& keypoints, const int32_t x, const int32_t y) { return keypoints.contains(x, y); }
+
+inline bool _KFASTFits(const KFASTScoreMap& keypoints, const int32_t x, const int32_t y) { return keypoints.contains(x, y); }
+
+// Decodes the frame in [data, data + size) into 'keypoints', which can be
+// any KFAST output type (a std::vector, KFASTKeypointsSoA, KFASTCornerMask...).
+// Returns false if the frame is malformed, if a keypoint falls outside a
+// KFASTCornerMask or KFASTScoreMap, or if one is past 65535 for an output
+// of KFASTCompactKeypoint; 'keypoints' then holds whatever was decoded
+// before the error.
+template <typename Keypoints>
+bool KFASTDecode(const uint8_t* const data, const size_t size, Keypoints& keypoints) {
+	const uint8_t* p = data;
+	const uint8_t* const end = data + size;
+	uint32_t count;
+	keypoints.clear();
+	// every keypoint takes at least a column byte and a score byte
+	if (!_KFASTGetVarint(p, end, count) || count > static_cast<size_t>(end - p) / 2) return false;
+	keypoints.reserve(count);
+	const uint8_t* const scores = end - count;
+	const uint8_t* score = scores;
+	int64_t y = -1;
+	while (score < end) {
+		uint32_t skip, run, x;
+		if (!_KFASTGetVarint(p, scores, skip) || !_KFASTGetVarint(p, scores, run) || !_KFASTGetVarint(p, scores, x)) return false;
+		y += static_cast<int64_t>(skip) + 1;
+		if (run == 0 || run > static_cast<size_t>(end - score) || y > INT32_MAX) return false;
+		int64_t col = x;
+		for (uint32_t k = 0;;) {
+			if (col > INT32_MAX || !_KFASTFits(keypoints, static_cast<int32_t>(col), static_cast<int32_t>(y))) return false;
+			keypoints.emplace_back(static_cast<int32_t>(col), static_cast<int32_t>(y), *score++);
+			if (++k == run) break;
+			if (!_KFASTGetVarint(p, scores, x)) return false;
+			col += static_cast<int64_t>(x) + 1;
+		}
+	}
+	_KFASTOutput<Keypoints>::finish(keypoints, 0, static_cast<int32_t>(y + 1));
+	return p == scores;
+}
+
+// Writes frames to a stream file as they come, then the frame index on close().
+class KFASTStreamWriter {
+public:
+	explicit KFASTStreamWriter(const char* const path) : file(fopen(path, "wb")) {
+		static const uint8_t header[16] = { 'K', 'F', 'A', 'S', 'T', 'S', 'T', 'R', 1, 0, 0, 0, 0, 0, 0, 0 };
+		put(header, sizeof(header));
+	}
+
+	KFASTStreamWriter(const KFASTStreamWriter&) = delete;
+	KFASTStreamWriter& operator=(const KFASTStreamWriter&) = delete;
+
+	~KFASTStreamWriter() { close(); }
+
+	// false once opening or any write has failed
+	bool ok() const { return file && !failed; }
+
+	// Appends one frame, in raster order. Returns false if the keypoints
+	// aren't in raster order (nothing is written) or the write failed.
+	template <typename KeypointT>
+	bool write(const KeypointT* const keypoints, const size_t count) {
+		buf.clear();
+		if (!ok() || !KFASTEncode(keypoints, count, buf)) return false;
+		offsets.push_back(pos);
+		put(buf.data(), buf.size());
+		return ok();
+	}
+
+	template <typename KeypointT, typename Alloc>
+	bool write(const std::vector<KeypointT, Alloc>& keypoints) { return write(keypoints.data(), keypoints.size()); }
+
+	uint64_t frames() const { return offsets.size(); }
+
+	// bytes written so far
+	uint64_t bytes() const { return pos; }
+
+	// Writes the frame index and trailer and closes the file.
+	// Returns false if anything failed to write.
+	bool close() {
+		if (!file) return false;
+		offsets.push_back(pos);
+		static const uint8_t zeros[8] = {};
+		put(zeros, (8 - (pos & 7)) & 7);
+		const uint64_t trailer[2] = { pos, offsets.size() - 1 };
+		put(offsets.data(), offsets.size() * sizeof(uint64_t));
+		put(trailer, sizeof(trailer));
+		put("KFASTIDX", 8);
+		if (fclose(file)) failed = true;
+		file = nullptr;
+		return !failed;
+	}
+
+private:
+	void put(const void* const data, const size_t size) {
+		if (!ok() || !size) return;
+		if (fwrite(data, 1, size, file) != size) failed = true;
+		pos += size;
+	}
+
+	FILE* file;
+	bool failed = false;
+	uint64_t pos = 0;
+	std::vector<uint64_t> offsets;
+	std::vector<uint8_t> buf;
+};
+
+// Reads a stream file written by KFASTStreamWriter. On Linux the file is
+// memory-mapped, so opening it costs nothing up front and frames are
+// decoded straight out of the page cache; elsewhere it's read into memory.
+class KFASTStreamReader {
+public:
+	explicit KFASTStreamReader(const char* const path) {
+#ifdef __linux__
+		const int fd = open(path, O_RDONLY);
+		if (fd < 0) return;
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0) {
+			void* const p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+			if (p != MAP_FAILED) {
+				base = static_cast<const uint8_t*>(p);
+				bytes = static_cast<size_t>(st.st_size);
+			}
+		}
+		::close(fd);
+#else
+		if (FILE* const f = fopen(path, "rb")) {
+			uint8_t chunk[65536];
+			size_t n;
+			while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) contents.insert(contents.end(), chunk, chunk + n);
+			fclose(f);
+			base = contents.data();
+			bytes = contents.size();
+		}
+#endif
+		if (!base || bytes < 16 + 8 + 24 || memcmp(base, "KFASTSTR", 8) || base[8] != 1) return;
+		// table offset, frames, "KFASTIDX"
+		uint64_t trailer[2];
+		memcpy(trailer, base + bytes - 24, sizeof(trailer));
+		if (memcmp(base + bytes - 8, "KFASTIDX", 8) || trailer[0] & 7 || trailer[0] > bytes - 24 || (bytes - 24 - trailer[0]) & 7) return;
+		// the table holds frames + 1 offsets; compared this way round so a huge frame count can't wrap
+		const uint64_t table_words = (bytes - 24 - trailer[0]) / sizeof(uint64_t);
+		if (table_words < 1 || trailer[1] != table_words - 1) return;
+		const uint64_t* const table = reinterpret_cast<const uint64_t*>(base + trailer[0]);
+		if (table[trailer[1]] > trailer[0]) return;
+		index = table;
+		num_frames = static_cast<size_t>(trailer[1]);
+	}
+
+	KFASTStreamReader(const KFASTStreamReader&) = delete;
+	KFASTStreamReader& operator=(const KFASTStreamReader&) = delete;
+
+	~KFASTStreamReader() {
+#ifdef __linux__
+		if (base) munmap(const_cast<uint8_t*>(base), bytes);
+#endif
+	}
+
+	// false if the file couldn't be opened or isn't a stream file
+	bool ok() const { return index != nullptr; }
+
+	size_t frames() const { return num_frames; }
+
+	// Frame i's encoded bytes, pointing into the file, or false if the index is corrupt there.
+	bool frame(const size_t i, const uint8_t*& data, size_t& size) const {
+		if (i >= num_frames || index[i] < 16 || index[i] > index[i + 1] || index[i + 1] > index[num_frames]) return false;
+		data = base + index[i];
+		size = static_cast<size_t>(index[i + 1] - index[i]);
+		return true;
+	}
+
+	// Frame i's scores in raster order, pointing into the file, and their count;
+	// null (and 0) if the frame is corrupt.
+	const uint8_t* scores(const size_t i, uint32_t& count) const {
+		const uint8_t* data;
+		size_t size;
+		count = 0;
+		if (!frame(i, data, size)) return nullptr;
+		const uint8_t* p = data;
+		if (!_KFASTGetVarint(p, data + size, count) || count > static_cast<size_t>(data + size - p)) {
+			count = 0;
+			return nullptr;
+		}
+		return data + size - count;
+	}
+
+	// decodes frame i into 'keypoints' (any KFAST output type); false if it's corrupt
+	template <typename Keypoints>
+	bool read(const size_t i, Keypoints& keypoints) const {
+		const uint8_t* data;
+		size_t size;
+		if (!frame(i, data, size)) {
+			keypoints.clear();
+			return false;
+		}
+		return KFASTDecode(data, size, keypoints);
+	}
+
+private:
+	const uint8_t* base = nullptr;
+	size_t bytes = 0;
+	const uint64_t* index = nullptr;
+	size_t num_frames = 0;
+#ifndef __linux__
+	std::vector<uint8_t> contents;
+#endif
+};
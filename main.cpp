@@ -58,15 +58,44 @@
 // 	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <future>
 #include <iomanip>
 #include <iostream>
+#include <new>
 #include <opencv2/opencv.hpp>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "KFAST.h"
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+// perf events are Linux-only; PerfCounter reads 0 elsewhere
+#define PERF_TYPE_HARDWARE 0
+#define PERF_COUNT_HW_CACHE_REFERENCES 0
+#define PERF_TYPE_HW_CACHE 0
+#define PERF_COUNT_HW_CACHE_DTLB 0
+#define PERF_COUNT_HW_CACHE_OP_READ 0
+#define PERF_COUNT_HW_CACHE_RESULT_MISS 0
+#endif
+
 extern "C" {
 #include "Rosten/fast.h"
 }
@@ -76,6 +105,34 @@ extern "C" {
 
 using namespace std::chrono;
 
+#ifdef _MSC_VER
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
+
+// Heap allocations made through operator new are counted while count_allocations
+// is set, so the driver can verify that a warmed-up KFASTDetector makes none.
+// (Off otherwise, to keep the counter out of the allocator benchmark.)
+// Kept out of line so that GCC doesn't see the malloc/free behind new/delete
+// and warn about mismatches.
+static std::atomic<bool> count_allocations{ false };
+static std::atomic<uint64_t> heap_allocations{ 0 };
+
+NOINLINE void* operator new(size_t size) {
+	if (count_allocations.load(std::memory_order_relaxed)) ++heap_allocations;
+	if (void* const p = malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+NOINLINE void operator delete(void* p) noexcept {
+	free(p);
+}
+
+NOINLINE void operator delete(void* p, size_t) noexcept {
+	free(p);
+}
+
 void printReport(const std::string& name, const nanoseconds& dur, const size_t num_keypoints, const int width, const nanoseconds& comp = nanoseconds(0)) {
 	std::cout << std::left << std::setprecision(6) << std::setw(10) << name << " took " << std::setw(7) << static_cast<double>(dur.count()) * 1e-3 << " us to find " << std::setw(width) << num_keypoints << (num_keypoints == 1 ? " keypoint" : " keypoints");
 	if (comp.count() && comp < dur) {
@@ -86,6 +143,86 @@ void printReport(const std::string& name, const nanoseconds& dur, const size_t n
 	}
 }
 
+// Hardware event counter for the calling thread. Reads 0 where
+// perf events are unavailable (non-Linux, or perf_event_paranoid too strict).
+class PerfCounter {
+public:
+	PerfCounter(const uint32_t type, const uint64_t config) {
+#ifdef __linux__
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+		(void)type;
+		(void)config;
+#endif
+	}
+
+	~PerfCounter() {
+#ifdef __linux__
+		if (fd >= 0) close(fd);
+#endif
+	}
+
+	bool valid() const { return fd >= 0; }
+
+	void start() {
+#ifdef __linux__
+		if (fd < 0) return;
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+	}
+
+	uint64_t stop() {
+		uint64_t count = 0;
+#ifdef __linux__
+		if (fd < 0) return 0;
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(fd, &count, sizeof(count)) != sizeof(count)) count = 0;
+#endif
+		return count;
+	}
+
+private:
+	int fd = -1;
+};
+
+void printLatency(const std::string& name, std::vector<nanoseconds>& lat) {
+	std::sort(lat.begin(), lat.end());
+	std::cout << std::left << std::setprecision(6) << std::setw(18) << name << " p50 " << std::setw(7) << static_cast<double>(lat[lat.size() / 2].count()) * 1e-3
+		<< " us, p99 " << std::setw(7) << static_cast<double>(lat[lat.size() * 99 / 100].count()) * 1e-3 << " us." << std::endl;
+}
+
+// stand-in for a descriptor stage: ORB-style intensity centroid orientation of each keypoint
+float describe(const cv::Mat& img, const std::vector<Keypoint>& kps) {
+	constexpr int r = 15;
+	float acc = 0.0f;
+	for (const Keypoint& kp : kps) {
+		if (kp.x < r || kp.y < r || kp.x >= img.cols - r || kp.y >= img.rows - r) continue;
+		int m01 = 0, m10 = 0;
+		for (int dy = -r; dy <= r; ++dy) {
+			const uint8_t* const row = img.data + (kp.y + dy) * img.step + kp.x;
+			for (int dx = -r; dx <= r; ++dx) {
+				m10 += dx * row[dx];
+				m01 += dy * row[dx];
+			}
+		}
+		acc += std::atan2(static_cast<float>(m01), static_cast<float>(m10));
+	}
+	return acc;
+}
+
+bool sameKeypoints(const std::vector<Keypoint>& a, const std::vector<Keypoint>& b) {
+	return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const Keypoint& p, const Keypoint& q) { return p.x == q.x && p.y == q.y && p.score == q.score; });
+}
+
 int main() {
 	// ------------- Configuration ------------
 	constexpr bool display_image = false;
@@ -94,6 +231,29 @@ int main() {
 	constexpr auto runs = 1000;
 	constexpr auto thresh = 50;
 	constexpr bool KFAST_multithread = true;
+	constexpr auto latency_runs = 2000;
+	constexpr auto latency_spin_us = 50;
+	constexpr auto pipeline_frames = 500;
+	constexpr auto video_frames = 500;
+	constexpr int qos_priorities[] = { 3, 2, 1, 0 };
+	constexpr auto qos_rounds = 100;
+	constexpr auto tile_cols = 2048;
+	constexpr int tile_widths[] = { 640, 1024, 2048, 4096, 8192, 16384 };
+	constexpr int prefetch_dists[] = { 0, 128, 256, 512, 1024, 2048 };
+	constexpr int alias_strides[] = { 4096, 4096 + 64, 8192 };
+	constexpr auto alias_runs = 50;
+	constexpr auto arena_instances = 16;
+	constexpr auto arena_frames = 200;
+	constexpr auto tlb_cols = 7680;
+	constexpr auto tlb_rows = 4320;
+	constexpr auto tlb_runs = 20;
+	constexpr auto order_cols = 3840;
+	constexpr auto order_rows = 2160;
+	constexpr auto order_runs = 20;
+	constexpr auto stream_frames = 1000;
+	constexpr auto delta_frames = 100;
+	constexpr int nms_radii[] = { 1, 2, 3, 5 };
+	constexpr auto stream_path = "KFAST_stream.kfs";
 	constexpr char name[] = "test.jpg";
 	// --------------------------------
 
@@ -124,6 +284,573 @@ int main() {
 	// --------------------------------
 
 
+	// ------------- KFASTDetector ------------
+	// the same detection through a reusable context,
+	// which must make no heap allocations once warmed up
+	nanoseconds detector_ns;
+	size_t detector_kps;
+	uint64_t detector_heap, detector_scratch;
+	{
+		KFASTDetector<KFAST_multithread, nonmax_suppress> detector;
+		for (int i = 0; i < warmups; ++i) detector.detect(image.data, image.cols, image.rows, static_cast<int>(image.step), thresh);
+		const uint64_t heap_before = heap_allocations;
+		const uint64_t scratch_before = detector.allocations();
+		count_allocations = true;
+		const high_resolution_clock::time_point start = high_resolution_clock::now();
+		for (int32_t i = 0; i < runs; ++i) {
+			detector.detect(image.data, image.cols, image.rows, static_cast<int>(image.step), thresh);
+		}
+		const high_resolution_clock::time_point end = high_resolution_clock::now();
+		count_allocations = false;
+		detector_ns = (end - start) / runs;
+		detector_heap = heap_allocations - heap_before;
+		detector_scratch = detector.allocations() - scratch_before;
+		detector_kps = detector.keypoints().size();
+	}
+	// --------------------------------
+
+
+	// warms up, then times the same detection as above into another kind of output
+	const auto timeKFAST = [&](auto& out) {
+		for (int i = 0; i < warmups; ++i) KFAST<KFAST_multithread, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), out, thresh);
+		const high_resolution_clock::time_point start = high_resolution_clock::now();
+		for (int32_t i = 0; i < runs; ++i) {
+			KFAST<KFAST_multithread, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), out, thresh);
+		}
+		return nanoseconds((high_resolution_clock::now() - start) / runs);
+	};
+
+
+	// ------------- KFAST SoA ------------
+	// the same detection into separate x, y and score arrays
+	KFASTKeypointsSoA soa_kps;
+	const nanoseconds soa_ns = timeKFAST(soa_kps);
+	// --------------------------------
+
+
+	// ------------- KFAST compact ------------
+	// the same detection into 5-byte keypoints
+	std::vector<KFASTCompactKeypoint> compact_kps;
+	const nanoseconds compact_ns = timeKFAST(compact_kps);
+	// --------------------------------
+
+
+	// ------------- KFAST CSR ------------
+	// the same detection into a row index, columns and scores
+	KFASTKeypointsCSR csr_kps;
+	const nanoseconds csr_ns = timeKFAST(csr_kps);
+	// --------------------------------
+
+
+	// ------------- KFAST corner mask ------------
+	// the same detection into a 1-bit-per-pixel mask
+	std::vector<uint64_t> mask_bits(static_cast<size_t>((image.cols + 63) >> 6) * image.rows);
+	KFASTCornerMask mask(mask_bits.data(), image.cols, image.rows);
+	const nanoseconds mask_ns = timeKFAST(mask);
+	// --------------------------------
+
+
+	// ------------- KFAST score map ------------
+	// the same detection into a dense map of scores
+	std::vector<uint8_t> score_map(static_cast<size_t>(image.cols) * image.rows);
+	KFASTScoreMap scores(score_map.data(), image.cols, image.rows);
+	const nanoseconds score_map_ns = timeKFAST(scores);
+	const size_t score_map_kps = static_cast<size_t>(score_map.size() - std::count(score_map.begin(), score_map.end(), 0));
+	// --------------------------------
+
+
+	// ------------- KFAST sink ------------
+	// single-threaded detection into a vector vs. a KFASTSink whose
+	// functor builds the same vector, to show the sink costs nothing
+	nanoseconds vector_ns, sink_ns;
+	std::vector<Keypoint> vector_kps, sink_kps;
+	{
+		auto sink_fn = makeKFASTSink<true>([&sink_kps](const int32_t x, const int32_t y, const uint8_t score) { sink_kps.emplace_back(x, y, score); });
+		for (nanoseconds* ns : { &vector_ns, &sink_ns }) {
+			for (int i = 0; i < warmups; ++i) {
+				sink_kps.clear();
+				if (ns == &sink_ns) KFAST<false, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), sink_fn, thresh);
+				else KFAST<false, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), vector_kps, thresh);
+			}
+			const high_resolution_clock::time_point start = high_resolution_clock::now();
+			for (int32_t i = 0; i < runs; ++i) {
+				sink_kps.clear();
+				if (ns == &sink_ns) KFAST<false, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), sink_fn, thresh);
+				else KFAST<false, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), vector_kps, thresh);
+			}
+			*ns = (high_resolution_clock::now() - start) / runs;
+		}
+	}
+	// --------------------------------
+
+
+	// ------------- KFAST output order ------------
+	// a 4K frame (the image tiled) detected into raster, tile-major and Morton
+	// order, then run through the describe() stand-in in that order
+	const KFASTOrder orders[] = { KFASTOrder::Raster, KFASTOrder::Tiles, KFASTOrder::Morton };
+	nanoseconds order_detect_ns[3], order_describe_ns[3];
+	size_t order_kps[3];
+	float order_sink = 0.0f;
+	{
+		cv::Mat big_src;
+		cv::repeat(image, order_rows / image.rows + 1, order_cols / image.cols + 1, big_src);
+		const cv::Mat big = big_src(cv::Rect(0, 0, order_cols, order_rows)).clone();
+		std::vector<Keypoint> kps;
+		for (int k = 0; k < 3; ++k) {
+			KFASTOrdered<> ordered(kps, orders[k]);
+			KFAST<KFAST_multithread, nonmax_suppress>(big.data, big.cols, big.rows, static_cast<int>(big.step), ordered, thresh);
+			high_resolution_clock::time_point start = high_resolution_clock::now();
+			for (int32_t i = 0; i < order_runs; ++i) KFAST<KFAST_multithread, nonmax_suppress>(big.data, big.cols, big.rows, static_cast<int>(big.step), ordered, thresh);
+			order_detect_ns[k] = (high_resolution_clock::now() - start) / order_runs;
+			order_sink += describe(big, kps);
+			start = high_resolution_clock::now();
+			for (int32_t i = 0; i < order_runs; ++i) order_sink += describe(big, kps);
+			order_describe_ns[k] = (high_resolution_clock::now() - start) / order_runs;
+			order_kps[k] = kps.size();
+		}
+	}
+	// --------------------------------
+
+
+	// ------------- KFAST score-sorted ------------
+	// the same detection sorted by descending score: a vector then
+	// std::stable_sort vs. KFASTScoreSorted's counting sort
+	nanoseconds std_sort_ns, score_sorted_ns;
+	std::vector<Keypoint> std_sorted_kps, score_sorted_kps;
+	{
+		const auto by_score = [](const Keypoint& a, const Keypoint& b) { return a.score > b.score; };
+		KFASTScoreSorted<> score_sorted(score_sorted_kps);
+		for (nanoseconds* ns : { &std_sort_ns, &score_sorted_ns }) {
+			for (int i = 0; i < warmups; ++i) {
+				if (ns == &score_sorted_ns) KFAST<KFAST_multithread, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), score_sorted, thresh);
+				else KFAST<KFAST_multithread, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), std_sorted_kps, thresh);
+			}
+			const high_resolution_clock::time_point start = high_resolution_clock::now();
+			for (int32_t i = 0; i < runs; ++i) {
+				if (ns == &score_sorted_ns) KFAST<KFAST_multithread, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), score_sorted, thresh);
+				else {
+					KFAST<KFAST_multithread, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), std_sorted_kps, thresh);
+					std::stable_sort(std_sorted_kps.begin(), std_sorted_kps.end(), by_score);
+				}
+			}
+			*ns = (high_resolution_clock::now() - start) / runs;
+		}
+	}
+	// --------------------------------
+
+
+	// ------------- KFAST stream ------------
+	// stream_frames copies of the test image's keypoints written to a stream
+	// file, then every frame read back from the memory-mapped file
+	nanoseconds encode_ns, decode_ns;
+	uint64_t stream_bytes = 0;
+	bool stream_agrees = true;
+	{
+		const high_resolution_clock::time_point start = high_resolution_clock::now();
+		{
+			KFASTStreamWriter writer(stream_path);
+			for (int32_t i = 0; i < stream_frames; ++i) writer.write(KFAST_kps);
+			stream_bytes = writer.bytes();
+			stream_agrees = writer.close();
+		}
+		encode_ns = (high_resolution_clock::now() - start) / stream_frames;
+		KFASTStreamReader reader(stream_path);
+		stream_agrees = stream_agrees && reader.ok() && reader.frames() == stream_frames;
+		std::vector<Keypoint> kps;
+		const high_resolution_clock::time_point decode_start = high_resolution_clock::now();
+		for (size_t i = 0; stream_agrees && i < reader.frames(); ++i) stream_agrees = reader.read(i, kps);
+		decode_ns = (high_resolution_clock::now() - decode_start) / stream_frames;
+		stream_agrees = stream_agrees && kps.size() == KFAST_kps.size()
+			&& std::equal(kps.begin(), kps.end(), KFAST_kps.begin(), [](const Keypoint& a, const Keypoint& b) { return a.x == b.x && a.y == b.y && a.score == b.score; });
+	}
+	std::remove(stream_path);
+	// --------------------------------
+
+
+	// ------------- KFAST delta ------------
+	// a static camera: the test image with a 64x64 inverted patch drifting
+	// across it, detected frame by frame as deltas from the previous frame
+	size_t delta_full = 0, delta_changes = 0;
+	nanoseconds delta_ns;
+	bool delta_agrees = true;
+	{
+		KFASTDetector<KFAST_multithread, nonmax_suppress> detector;
+		KFASTDelta<> delta;
+		std::vector<Keypoint> received, rebuilt;
+		cv::Mat frame = image.clone();
+		const high_resolution_clock::time_point start = high_resolution_clock::now();
+		for (int32_t f = 0; f < delta_frames; ++f) {
+			image.copyTo(frame);
+			for (int32_t y = 0; y < 64; ++y) {
+				uint8_t* const row = frame.ptr(image.rows / 4 + y + f % (image.rows / 2)) + image.cols / 4 + 2 * (f % (image.cols / 4));
+				for (int32_t x = 0; x < 64; ++x) row[x] = static_cast<uint8_t>(255 - row[x]);
+			}
+			const std::vector<Keypoint>& kps = detector.detect(frame.data, frame.cols, frame.rows, static_cast<int>(frame.step), thresh, delta);
+			KFASTApply(received, delta, rebuilt);
+			received.swap(rebuilt);
+			delta_agrees = delta_agrees && received.size() == kps.size()
+				&& std::equal(kps.begin(), kps.end(), received.begin(), [](const Keypoint& a, const Keypoint& b) { return a.x == b.x && a.y == b.y && a.score == b.score; });
+			if (f) {
+				delta_full += kps.size();
+				delta_changes += delta.size();
+			}
+		}
+		delta_ns = (high_resolution_clock::now() - start) / delta_frames;
+	}
+	// --------------------------------
+
+
+	// ------------- KFAST NMS radius ------------
+	// non-max suppression over 3x3 up to 11x11 windows
+	std::vector<nanoseconds> radius_ns;
+	std::vector<size_t> radius_kps;
+	bool radius_nested = true;
+	{
+		std::vector<Keypoint> kps, narrower;
+		for (const int radius : nms_radii) {
+			KFASTTuning tuning;
+			tuning.nms_radius = radius;
+			KFAST<KFAST_multithread, true>(image.data, image.cols, image.rows, static_cast<int>(image.step), kps, thresh, KFASTDefaultPool(), tuning);
+			const high_resolution_clock::time_point start = high_resolution_clock::now();
+			for (int32_t i = 0; i < runs; ++i) KFAST<KFAST_multithread, true>(image.data, image.cols, image.rows, static_cast<int>(image.step), kps, thresh, KFASTDefaultPool(), tuning);
+			radius_ns.push_back((high_resolution_clock::now() - start) / runs);
+			radius_kps.push_back(kps.size());
+
+			// a wider window only ever suppresses more
+			radius_nested = radius_nested && (radius == nms_radii[0] || std::includes(narrower.begin(), narrower.end(), kps.begin(), kps.end(),
+				[](const Keypoint& a, const Keypoint& b) { return a.y < b.y || (a.y == b.y && a.x < b.x); }));
+			narrower.swap(kps);
+		}
+	}
+	// --------------------------------
+
+
+	// ------------- KFAST progressive ------------
+	// the same detection delivered chunk by chunk: time until the top chunk
+	// reaches the caller vs. until the whole frame has
+	nanoseconds first_chunk_ns{ 0 }, progressive_ns;
+	std::vector<Keypoint> progressive_kps;
+	{
+		high_resolution_clock::time_point start;
+		nanoseconds first_sum{ 0 };
+		const auto on_chunk = [&](std::vector<Keypoint>& kps, int32_t begin_row, int32_t) {
+			if (begin_row == 0) first_sum += high_resolution_clock::now() - start;
+			progressive_kps.insert(progressive_kps.end(), kps.begin(), kps.end());
+		};
+		for (int i = 0; i < warmups; ++i) {
+			progressive_kps.clear();
+			start = high_resolution_clock::now();
+			KFASTProgressive<KFAST_multithread, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), thresh, on_chunk);
+		}
+		first_sum = nanoseconds(0);
+		const high_resolution_clock::time_point all_start = high_resolution_clock::now();
+		for (int32_t i = 0; i < runs; ++i) {
+			progressive_kps.clear();
+			start = high_resolution_clock::now();
+			KFASTProgressive<KFAST_multithread, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), thresh, on_chunk);
+		}
+		progressive_ns = (high_resolution_clock::now() - all_start) / runs;
+		first_chunk_ns = first_sum / runs;
+	}
+	// --------------------------------
+
+
+	// ------------- KFAST span ------------
+	// the same detection written straight into a caller buffer,
+	// plus one call into a buffer too small for it to check overflow reporting
+	nanoseconds span_ns;
+	std::vector<Keypoint> span_kps(KFAST_kps.size());
+	size_t span_found, overflow_found;
+	{
+		for (int i = 0; i < warmups; ++i) KFAST<KFAST_multithread, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), span_kps.data(), span_kps.size(), thresh);
+		const high_resolution_clock::time_point start = high_resolution_clock::now();
+		for (int32_t i = 0; i < runs; ++i) {
+			span_found = KFAST<KFAST_multithread, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), span_kps.data(), span_kps.size(), thresh);
+		}
+		const high_resolution_clock::time_point end = high_resolution_clock::now();
+		span_ns = (end - start) / runs;
+		std::vector<Keypoint> half(span_kps.size() / 2);
+		overflow_found = KFAST<KFAST_multithread, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), half.data(), half.size(), thresh);
+	}
+	// --------------------------------
+
+
+	// ------------- KFAST allocators ------------
+	// arena_instances single-threaded detectors running side by side,
+	// each with a fresh keypoint vector per frame, from malloc vs. a per-instance KFASTArena
+	nanoseconds malloc_frame_ns, arena_frame_ns;
+	std::atomic<size_t> arena_found{ 0 };
+	{
+		typedef std::vector<Keypoint, KFASTArenaAllocator<Keypoint>> ArenaKeypoints;
+		for (nanoseconds* frame_ns : { &malloc_frame_ns, &arena_frame_ns }) {
+			std::vector<std::thread> instances;
+			const high_resolution_clock::time_point start = high_resolution_clock::now();
+			for (int t = 0; t < arena_instances; ++t) {
+				instances.emplace_back([&, frame_ns] {
+					KFASTArena arena;
+					size_t n = 0;
+					for (int32_t i = 0; i < arena_frames; ++i) {
+						if (frame_ns == &arena_frame_ns) {
+							ArenaKeypoints kps(arena);
+							KFAST<false, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), kps, thresh);
+							n += kps.size();
+						}
+						else {
+							std::vector<Keypoint> kps;
+							KFAST<false, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), kps, thresh);
+							n += kps.size();
+						}
+						arena.reset();
+					}
+					arena_found += n;
+				});
+			}
+			for (std::thread& instance : instances) instance.join();
+			*frame_ns = (high_resolution_clock::now() - start) / (arena_instances * arena_frames);
+		}
+	}
+	// --------------------------------
+
+
+	// ------------- KFAST huge pages ------------
+	// single-threaded detection on an 8K frame tiled from the image,
+	// with frame and detector scratch on 4 KB vs. 2 MB pages
+	nanoseconds small_pages_ns, huge_pages_ns;
+	double small_pages_tlb, huge_pages_tlb;
+	bool have_tlb_misses, got_huge_pages = false;
+	{
+		PerfCounter tlb_misses(PERF_TYPE_HW_CACHE,
+			PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+		have_tlb_misses = tlb_misses.valid();
+		for (const bool huge : { false, true }) {
+			KFASTFrame frame(tlb_cols, tlb_rows, huge);
+			if (huge) got_huge_pages = frame.huge();
+			for (int32_t r = 0; r < frame.rows; ++r) {
+				const uint8_t* const src = image.data + (r % image.rows) * image.step;
+				for (int32_t c = 0; c < frame.cols; c += image.cols) memcpy(frame.row(r) + c, src, std::min(image.cols, frame.cols - c));
+			}
+			KFASTTuning tuning;
+			tuning.huge_pages = huge;
+			KFASTDetector<false, nonmax_suppress> detector(nullptr, tuning);
+			detector.detect(frame.data(), frame.cols, frame.rows, frame.stride, thresh);
+			tlb_misses.start();
+			const high_resolution_clock::time_point start = high_resolution_clock::now();
+			for (int32_t i = 0; i < tlb_runs; ++i) detector.detect(frame.data(), frame.cols, frame.rows, frame.stride, thresh);
+			const high_resolution_clock::time_point end = high_resolution_clock::now();
+			const double misses = static_cast<double>(tlb_misses.stop()) / tlb_runs;
+			(huge ? huge_pages_ns : small_pages_ns) = (end - start) / tlb_runs;
+			(huge ? huge_pages_tlb : small_pages_tlb) = misses;
+		}
+	}
+	// --------------------------------
+
+
+	// ------------- KFAST latency ------------
+	// per-call latency on a small (640x480) frame, as for a high-rate VIO front end,
+	// with pooled workers blocking between frames vs. spinning for latency_spin_us
+	std::vector<nanoseconds> block_lat, spin_lat;
+	{
+		const cv::Mat small = image(cv::Rect(0, 0, std::min(640, image.cols), std::min(480, image.rows))).clone();
+		std::vector<Keypoint> kps;
+		KFASTPool pool;
+		for (auto* lat : { &block_lat, &spin_lat }) {
+			pool.setSpin(lat == &spin_lat ? microseconds(latency_spin_us) : microseconds(0));
+			for (int i = 0; i < warmups; ++i) KFAST<true, nonmax_suppress>(small.data, small.cols, small.rows, static_cast<int>(small.step), kps, thresh, pool);
+			for (int32_t i = 0; i < latency_runs; ++i) {
+				const high_resolution_clock::time_point start = high_resolution_clock::now();
+				KFAST<true, nonmax_suppress>(small.data, small.cols, small.rows, static_cast<int>(small.step), kps, thresh, pool);
+				lat->push_back(high_resolution_clock::now() - start);
+			}
+		}
+	}
+	// --------------------------------
+
+
+	// ------------- KFAST pipeline ------------
+	// capture -> detect -> describe loop, run back to back vs. with KFASTAsync
+	// overlapping detection of frame N with capture of N+1 and description of N-1
+	nanoseconds sync_frame_ns, async_frame_ns;
+	float sink = 0.0f;
+	{
+		cv::Mat frames[2] = { image.clone(), image.clone() };
+		std::vector<Keypoint> kps[2];
+		{
+			const high_resolution_clock::time_point start = high_resolution_clock::now();
+			for (int32_t i = 0; i < pipeline_frames; ++i) {
+				image.copyTo(frames[0]);
+				KFAST<KFAST_multithread, nonmax_suppress>(frames[0].data, frames[0].cols, frames[0].rows, static_cast<int>(frames[0].step), kps[0], thresh);
+				sink += describe(frames[0], kps[0]);
+			}
+			sync_frame_ns = (high_resolution_clock::now() - start) / pipeline_frames;
+		}
+		{
+			const high_resolution_clock::time_point start = high_resolution_clock::now();
+			image.copyTo(frames[0]);
+			std::future<void> detected = KFASTAsync<KFAST_multithread, nonmax_suppress>(frames[0].data, frames[0].cols, frames[0].rows, static_cast<int>(frames[0].step), kps[0], thresh);
+			for (int32_t i = 0; i < pipeline_frames; ++i) {
+				cv::Mat& cur = frames[i & 1];
+				cv::Mat& next = frames[(i + 1) & 1];
+				if (i + 1 < pipeline_frames) image.copyTo(next);
+				detected.wait();
+				if (i + 1 < pipeline_frames) detected = KFASTAsync<KFAST_multithread, nonmax_suppress>(next.data, next.cols, next.rows, static_cast<int>(next.step), kps[(i + 1) & 1], thresh);
+				sink += describe(cur, kps[i & 1]);
+			}
+			async_frame_ns = (high_resolution_clock::now() - start) / pipeline_frames;
+		}
+	}
+	// --------------------------------
+
+
+	// ------------- KFAST video ------------
+	// video_frames copies of the image through KFASTVideo, live (each frame
+	// waited for before the next, latency target 0) vs. offline (all queued
+	// at once, no latency target)
+	nanoseconds video_frame_ns[2];
+	uint64_t video_split[2], video_whole[2];
+	std::atomic<bool> video_agrees{ true };
+	{
+		for (int k = 0; k < 2; ++k) {
+			const bool live = k == 0;
+			KFASTVideo<nonmax_suppress> video([&](uint64_t, std::vector<Keypoint>& kps) { if (!sameKeypoints(kps, KFAST_kps)) video_agrees = false; },
+				live ? nanoseconds(0) : nanoseconds(hours(1)));
+			const high_resolution_clock::time_point start = high_resolution_clock::now();
+			for (int32_t i = 0; i < video_frames; ++i) {
+				video.submit(image.data, image.cols, image.rows, static_cast<int>(image.step), thresh);
+				if (live) video.flush();
+			}
+			video.flush();
+			video_frame_ns[k] = (high_resolution_clock::now() - start) / video_frames;
+			video_split[k] = video.splitFrames();
+			video_whole[k] = video.wholeFrames();
+		}
+	}
+	// --------------------------------
+
+
+	// ------------- KFAST anytime ------------
+	// deadline-bounded detection: with an hour to spare it must cover the whole
+	// frame and match the vector output, with a deadline already past it must
+	// cover nothing, and with half a frame's time it covers what it can
+	bool anytime_agrees;
+	double anytime_half = 0.0;
+	{
+		std::vector<Keypoint> kps;
+		KFASTCoverage coverage = KFASTAnytime<KFAST_multithread, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), kps, thresh,
+			steady_clock::now() + hours(1));
+		anytime_agrees = coverage.fraction == 1.0f && coverage.chunks_done == coverage.chunks && sameKeypoints(kps, KFAST_kps);
+		coverage = KFASTAnytime<KFAST_multithread, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), kps, thresh,
+			steady_clock::now() - seconds(1));
+		anytime_agrees = anytime_agrees && coverage.fraction == 0.0f && coverage.chunks_done == 0 && kps.empty();
+		for (int32_t i = 0; i < runs; ++i) {
+			coverage = KFASTAnytime<KFAST_multithread, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), kps, thresh,
+				steady_clock::now() + KFAST_ns / 2);
+			anytime_half += coverage.fraction;
+		}
+		anytime_half /= runs;
+	}
+	// --------------------------------
+
+
+	// ------------- KFAST streams ------------
+	// one frame of the image per stream per round, on streams of descending
+	// priority sharing one KFASTStreams, with a deadline of two frames' worth
+	// of multithreaded detection: the top streams should make it, the bottom drop
+	std::vector<KFASTStreams<nonmax_suppress>::Stats> qos_stats;
+	std::atomic<bool> qos_agrees{ true };
+	{
+		KFASTStreams<nonmax_suppress> streams([&](int32_t, uint64_t, std::vector<Keypoint>& kps, bool dropped) {
+			if (!dropped && !sameKeypoints(kps, KFAST_kps)) qos_agrees = false;
+		});
+		std::vector<int32_t> ids;
+		for (const int priority : qos_priorities) ids.push_back(streams.addStream(priority));
+		for (int32_t i = 0; i < qos_rounds; ++i) {
+			const steady_clock::time_point deadline = steady_clock::now() + 2 * KFAST_ns;
+			for (const int32_t id : ids) streams.submit(id, image.data, image.cols, image.rows, static_cast<int>(image.step), thresh, deadline);
+			streams.flush();
+		}
+		for (const int32_t id : ids) qos_stats.push_back(streams.stats(id));
+	}
+	// --------------------------------
+
+
+	// ------------- KFAST tiling ------------
+	// single-threaded cycles per pixel on wide images (the test image repeated
+	// horizontally), sweeping full-width rows vs. tile_cols-wide column strips
+	std::vector<double> full_cpp, tiled_cpp;
+	{
+		KFASTInlineExecutor inline_executor;
+		KFASTTuning tiled;
+		tiled.tile_cols = tile_cols;
+		cv::Mat wide_src;
+		cv::repeat(image, 1, 16384 / image.cols + 1, wide_src);
+		std::vector<Keypoint> kps;
+		for (const int width : tile_widths) {
+			const cv::Mat wide = wide_src(cv::Rect(0, 0, width, image.rows)).clone();
+			const int reps = std::max(10, runs * image.cols / width / 4);
+			for (auto* cpp : { &full_cpp, &tiled_cpp }) {
+				const KFASTTuning tuning = cpp == &tiled_cpp ? tiled : KFASTTuning();
+				KFAST<false, nonmax_suppress>(wide.data, wide.cols, wide.rows, static_cast<int>(wide.step), kps, thresh, inline_executor, tuning);
+				const uint64_t start = __rdtsc();
+				for (int i = 0; i < reps; ++i) KFAST<false, nonmax_suppress>(wide.data, wide.cols, wide.rows, static_cast<int>(wide.step), kps, thresh, inline_executor, tuning);
+				cpp->push_back(static_cast<double>(__rdtsc() - start) / (static_cast<double>(reps) * wide.cols * wide.rows));
+			}
+		}
+	}
+	// --------------------------------
+
+
+	// ------------- KFAST prefetch ------------
+	// single-threaded throughput and L2 misses (LLC references, i.e. requests
+	// that missed L2) per 1000 pixels at each software prefetch distance
+	std::vector<nanoseconds> prefetch_ns;
+	std::vector<double> prefetch_l2;
+	bool have_l2_misses;
+	{
+		KFASTInlineExecutor inline_executor;
+		PerfCounter l2_misses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES);
+		have_l2_misses = l2_misses.valid();
+		std::vector<Keypoint> kps;
+		for (const int dist : prefetch_dists) {
+			KFASTTuning tuning;
+			tuning.prefetch_dist = dist;
+			for (int i = 0; i < warmups; ++i) KFAST<false, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), kps, thresh, inline_executor, tuning);
+			l2_misses.start();
+			const high_resolution_clock::time_point start = high_resolution_clock::now();
+			for (int32_t i = 0; i < runs; ++i) KFAST<false, nonmax_suppress>(image.data, image.cols, image.rows, static_cast<int>(image.step), kps, thresh, inline_executor, tuning);
+			prefetch_ns.push_back((high_resolution_clock::now() - start) / runs);
+			prefetch_l2.push_back(1000.0 * static_cast<double>(l2_misses.stop()) / (static_cast<double>(runs) * image.cols * image.rows));
+		}
+	}
+	// --------------------------------
+
+
+	// ------------- KFAST stride aliasing ------------
+	// single-threaded time on a 4096-wide image (the test image repeated)
+	// at pathological and padded strides, as is vs. with KFASTRepitch::Auto
+	std::vector<nanoseconds> alias_ns, repitch_ns;
+	{
+		KFASTInlineExecutor inline_executor;
+		KFASTTuning repitch;
+		repitch.repitch = KFASTRepitch::Auto;
+		cv::Mat wide_src;
+		cv::repeat(image, 1, 4096 / image.cols + 1, wide_src);
+		std::vector<Keypoint> kps;
+		for (const int pitch : alias_strides) {
+			// allocate one spare row so the last row's vector loads stay in bounds
+			cv::Mat buf(image.rows + 1, pitch, CV_8UC1);
+			wide_src(cv::Rect(0, 0, 4096, image.rows)).copyTo(buf(cv::Rect(0, 0, 4096, image.rows)));
+			for (auto* ns : { &alias_ns, &repitch_ns }) {
+				const KFASTTuning tuning = ns == &repitch_ns ? repitch : KFASTTuning();
+				KFAST<false, nonmax_suppress>(buf.data, 4096, image.rows, pitch, kps, thresh, inline_executor, tuning);
+				const high_resolution_clock::time_point start = high_resolution_clock::now();
+				for (int i = 0; i < alias_runs; ++i) KFAST<false, nonmax_suppress>(buf.data, 4096, image.rows, pitch, kps, thresh, inline_executor, tuning);
+				ns->push_back((high_resolution_clock::now() - start) / alias_runs);
+			}
+		}
+	}
+	// --------------------------------
+
+
 	// ------------- OpenCV ------------
 	std::vector<cv::KeyPoint> CV_kps;
 	nanoseconds CV_ns;
@@ -179,14 +906,167 @@ int main() {
 		if (i == R_size) std::cout << "All keypoints agree! Test valid." << std::endl << std::endl;
 	}
 	free(R_kps);
+	bool soa_agrees = soa_kps.size() == KFAST_kps.size();
+	for (size_t i = 0; soa_agrees && i < soa_kps.size(); ++i) soa_agrees = soa_kps.x()[i] == KFAST_kps[i].x && soa_kps.y()[i] == KFAST_kps[i].y;
+	if (!soa_agrees) {
+		std::cerr << "ERROR! SoA output disagrees with vector output!" << std::endl << std::endl;
+	}
+	if (compact_kps.size() != KFAST_kps.size()
+		|| !std::equal(compact_kps.begin(), compact_kps.end(), KFAST_kps.begin(), [](const KFASTCompactKeypoint& a, const Keypoint& b) { return a.x == b.x && a.y == b.y && a.score == b.score; })) {
+		std::cerr << "ERROR! Compact output disagrees with vector output!" << std::endl << std::endl;
+	}
+	bool csr_agrees = csr_kps.size() == KFAST_kps.size() && csr_kps.rows() == image.rows;
+	for (int32_t y = 0; csr_agrees && y < image.rows; ++y) {
+		for (uint32_t k = csr_kps.rowPtr()[y]; csr_agrees && k < csr_kps.rowPtr()[y + 1]; ++k) csr_agrees = KFAST_kps[k].y == y && KFAST_kps[k].x == csr_kps.x()[k];
+	}
+	if (!csr_agrees) {
+		std::cerr << "ERROR! CSR output disagrees with vector output!" << std::endl << std::endl;
+	}
+	if (mask.count() != KFAST_kps.size() || !std::all_of(KFAST_kps.begin(), KFAST_kps.end(), [&mask](const Keypoint& kp) { return mask.test(kp.x, kp.y); })) {
+		std::cerr << "ERROR! Corner mask disagrees with vector output!" << std::endl << std::endl;
+	}
+	if (score_map_kps != KFAST_kps.size() || (nonmax_suppress && !std::all_of(KFAST_kps.begin(), KFAST_kps.end(),
+		[&](const Keypoint& kp) { return score_map[static_cast<size_t>(kp.y) * image.cols + kp.x] == kp.score; }))) {
+		std::cerr << "ERROR! Score map disagrees with vector output!" << std::endl << std::endl;
+	}
+	if (sink_kps.size() != vector_kps.size()
+		|| !std::equal(sink_kps.begin(), sink_kps.end(), vector_kps.begin(), [](const Keypoint& a, const Keypoint& b) { return a.x == b.x && a.y == b.y && a.score == b.score; })) {
+		std::cerr << "ERROR! Sink output disagrees with vector output!" << std::endl << std::endl;
+	}
+	if (order_kps[1] != order_kps[0] || order_kps[2] != order_kps[0]) {
+		std::cerr << "ERROR! Output orders found different numbers of keypoints!" << std::endl << std::endl;
+	}
+	if (score_sorted_kps.size() != std_sorted_kps.size() || (nonmax_suppress && !std::equal(score_sorted_kps.begin(), score_sorted_kps.end(), std_sorted_kps.begin(),
+		[](const Keypoint& a, const Keypoint& b) { return a.x == b.x && a.y == b.y && a.score == b.score; }))) {
+		std::cerr << "ERROR! Score-sorted output disagrees with sorted vector output!" << std::endl << std::endl;
+	}
+	if (!video_agrees) {
+		std::cerr << "ERROR! KFASTVideo output disagrees with vector output!" << std::endl << std::endl;
+	}
+	if (!anytime_agrees) {
+		std::cerr << "ERROR! KFASTAnytime coverage or output is wrong!" << std::endl << std::endl;
+	}
+	if (!qos_agrees) {
+		std::cerr << "ERROR! KFASTStreams output disagrees with vector output!" << std::endl << std::endl;
+	}
+	if (!radius_nested) {
+		std::cerr << "ERROR! A wider NMS window kept a keypoint a narrower one suppressed!" << std::endl << std::endl;
+	}
+	if (!delta_agrees) {
+		std::cerr << "ERROR! Keypoints rebuilt from deltas disagree with detector output!" << std::endl << std::endl;
+	}
+	if (!stream_agrees) {
+		std::cerr << "ERROR! Keypoints read back from the stream file disagree with vector output!" << std::endl << std::endl;
+	}
+	if (progressive_kps.size() != KFAST_kps.size()
+		|| !std::equal(progressive_kps.begin(), progressive_kps.end(), KFAST_kps.begin(), [](const Keypoint& a, const Keypoint& b) { return a.x == b.x && a.y == b.y; })) {
+		std::cerr << "ERROR! Progressive output disagrees with vector output!" << std::endl << std::endl;
+	}
+	if (span_found != KFAST_kps.size() || overflow_found != KFAST_kps.size()
+		|| !std::equal(span_kps.begin(), span_kps.end(), KFAST_kps.begin(), [](const Keypoint& a, const Keypoint& b) { return a.x == b.x && a.y == b.y; })) {
+		std::cerr << "ERROR! Span output disagrees with vector output!" << std::endl << std::endl;
+	}
+	if (arena_found != 2 * static_cast<size_t>(arena_instances) * arena_frames * KFAST_kps.size()) {
+		std::cerr << "ERROR! Concurrent detectors found the wrong number of keypoints!" << std::endl << std::endl;
+	}
+	if (detector_heap || detector_scratch) {
+		std::cerr << "ERROR! KFASTDetector made " << detector_heap << " heap allocations and grew its scratch " << detector_scratch << " times in steady state!" << std::endl << std::endl;
+	}
+	else {
+		std::cout << "KFASTDetector made no allocations in steady state." << std::endl << std::endl;
+	}
 	// --------------------------------
 
 	
 	// ------------- Output ------------
 	const int max_width = static_cast<int>(ceil(log10(std::max(std::max(KFAST_kps.size(), CV_kps.size()), static_cast<size_t>(R_size)))));
 	printReport("KFAST", KFAST_ns, KFAST_kps.size(), max_width);
+	printReport("Detector", detector_ns, detector_kps, max_width);
+	printReport("Span", span_ns, span_found, max_width);
+	printReport("SoA", soa_ns, soa_kps.size(), max_width);
+	printReport("Compact", compact_ns, compact_kps.size(), max_width);
+	printReport("CSR", csr_ns, csr_kps.size(), max_width);
+	printReport("Mask", mask_ns, mask.count(), max_width);
+	printReport("Score map", score_map_ns, score_map_kps, max_width);
 	printReport("OpenCV", CV_ns, CV_kps.size(), max_width, KFAST_ns);
 	printReport("Dr. Rosten", R_ns, R_size, max_width, KFAST_ns);
+	std::cout << std::endl << "Keypoint output: " << KFAST_kps.size() * sizeof(Keypoint) << " bytes, compact: "
+		<< compact_kps.size() * sizeof(KFASTCompactKeypoint) << " bytes." << std::endl;
+	std::cout << std::endl << "KFAST latency on 640x480:" << std::endl;
+	printLatency("pool, blocking", block_lat);
+	printLatency("pool, spinning", spin_lat);
+	std::cout << std::endl << "Capture -> detect -> describe pipeline (checksum " << sink << "):" << std::endl;
+	std::cout << std::left << std::setprecision(6) << std::setw(18) << "sequential" << ' ' << 1e9 / static_cast<double>(sync_frame_ns.count()) << " frames/s." << std::endl;
+	std::cout << std::left << std::setprecision(6) << std::setw(18) << "KFASTAsync" << ' ' << 1e9 / static_cast<double>(async_frame_ns.count()) << " frames/s." << std::endl;
+	std::cout << std::endl << "KFASTVideo, " << video_frames << " frames:" << std::endl;
+	for (int k = 0; k < 2; ++k) {
+		std::cout << std::left << std::setprecision(6) << std::setw(18) << (k == 0 ? "live" : "offline") << ' ' << std::setw(7) << 1e9 / static_cast<double>(video_frame_ns[k].count())
+			<< " frames/s, " << video_split[k] << " split, " << video_whole[k] << " whole" << std::endl;
+	}
+	std::cout << std::endl << "KFASTAnytime with half a frame's time: " << std::setprecision(4) << 100.0 * anytime_half << "% of rows covered" << std::endl;
+	std::cout << std::endl << "KFASTStreams, " << qos_rounds << " rounds, deadline " << std::setprecision(6) << 2e-3 * static_cast<double>(KFAST_ns.count()) << " us:" << std::endl;
+	for (size_t i = 0; i < qos_stats.size(); ++i) {
+		std::cout << std::left << "priority " << std::setw(9) << qos_priorities[i] << ' ' << std::setw(4) << qos_stats[i].completed << " done, " << std::setw(4) << qos_stats[i].dropped
+			<< " dropped, latency mean " << std::setprecision(6) << std::setw(7) << static_cast<double>(qos_stats[i].mean_latency.count()) * 1e-3
+			<< " us, max " << static_cast<double>(qos_stats[i].max_latency.count()) * 1e-3 << " us" << std::endl;
+	}
+	std::cout << std::endl << order_cols << 'x' << order_rows << " frame by output order, detect + describe (checksum " << order_sink << "):" << std::endl;
+	for (int k = 0; k < 3; ++k) {
+		std::cout << std::left << std::setprecision(6) << std::setw(18) << (k == 0 ? "raster" : k == 1 ? "tiles" : "Morton") << ' ' << std::setw(7)
+			<< static_cast<double>(order_detect_ns[k].count()) * 1e-3 << " us + " << static_cast<double>(order_describe_ns[k].count()) * 1e-3 << " us" << std::endl;
+	}
+	std::cout << std::endl << "Sorted by descending score:" << std::endl;
+	std::cout << std::left << std::setprecision(6) << std::setw(18) << "std::stable_sort" << ' ' << static_cast<double>(std_sort_ns.count()) * 1e-3 << " us" << std::endl;
+	std::cout << std::left << std::setprecision(6) << std::setw(18) << "KFASTScoreSorted" << ' ' << static_cast<double>(score_sorted_ns.count()) * 1e-3 << " us" << std::endl;
+	{
+		const double kps_bytes = static_cast<double>(KFAST_kps.size() * sizeof(Keypoint));
+		std::cout << std::endl << "Stream file, " << stream_frames << " frames: " << std::setprecision(4)
+			<< static_cast<double>(stream_bytes) / (static_cast<double>(KFAST_kps.size()) * stream_frames) << " bytes/keypoint (Keypoint: " << sizeof(Keypoint) << ")" << std::endl;
+		std::cout << std::left << std::setprecision(6) << std::setw(18) << "encode + write" << ' ' << kps_bytes / static_cast<double>(encode_ns.count()) << " GB/s of keypoints" << std::endl;
+		std::cout << std::left << std::setprecision(6) << std::setw(18) << "decode from mmap" << ' ' << kps_bytes / static_cast<double>(decode_ns.count()) << " GB/s of keypoints" << std::endl;
+	}
+	std::cout << std::endl << "Static camera, " << delta_frames << " frames: " << delta_changes << " delta entries vs. " << delta_full << " keypoints ("
+		<< std::setprecision(4) << static_cast<double>(delta_full) / static_cast<double>(std::max(delta_changes, static_cast<size_t>(1))) << "x fewer), "
+		<< std::setprecision(6) << static_cast<double>(delta_ns.count()) * 1e-3 << " us/frame" << std::endl;
+	std::cout << std::endl << "Non-max suppression window:" << std::endl;
+	for (size_t i = 0; i < radius_ns.size(); ++i) {
+		const std::string window = std::to_string(2 * nms_radii[i] + 1) + 'x' + std::to_string(2 * nms_radii[i] + 1);
+		std::cout << std::left << std::setprecision(6) << std::setw(18) << window << ' ' << std::setw(7) << static_cast<double>(radius_ns[i].count()) * 1e-3
+			<< " us, " << radius_kps[i] << " keypoints" << std::endl;
+	}
+	std::cout << std::endl << "KFASTProgressive latency:" << std::endl;
+	std::cout << std::left << std::setprecision(6) << std::setw(18) << "first chunk" << ' ' << static_cast<double>(first_chunk_ns.count()) * 1e-3 << " us" << std::endl;
+	std::cout << std::left << std::setprecision(6) << std::setw(18) << "whole frame" << ' ' << static_cast<double>(progressive_ns.count()) * 1e-3 << " us" << std::endl;
+	std::cout << std::endl << "Single-threaded output, vector vs. KFASTSink:" << std::endl;
+	std::cout << std::left << std::setprecision(6) << std::setw(18) << "std::vector" << ' ' << static_cast<double>(vector_ns.count()) * 1e-3 << " us" << std::endl;
+	std::cout << std::left << std::setprecision(6) << std::setw(18) << "KFASTSink" << ' ' << static_cast<double>(sink_ns.count()) * 1e-3 << " us" << std::endl;
+	std::cout << std::endl << arena_instances << " concurrent single-threaded detectors:" << std::endl;
+	std::cout << std::left << std::setprecision(6) << std::setw(18) << "malloc" << ' ' << 1e9 / static_cast<double>(malloc_frame_ns.count()) << " frames/s." << std::endl;
+	std::cout << std::left << std::setprecision(6) << std::setw(18) << "KFASTArena" << ' ' << 1e9 / static_cast<double>(arena_frame_ns.count()) << " frames/s." << std::endl;
+	std::cout << std::endl << "Single-threaded " << tlb_cols << 'x' << tlb_rows << " frame (dTLB load misses per frame)"
+		<< (got_huge_pages ? ":" : ", 2 MB pages unavailable:") << std::endl;
+	std::cout << std::left << std::setprecision(6) << std::setw(18) << "4 KB pages" << ' ' << std::setw(7) << static_cast<double>(small_pages_ns.count()) * 1e-3
+		<< " us, " << (have_tlb_misses ? std::to_string(small_pages_tlb) : "n/a") << std::endl;
+	std::cout << std::left << std::setprecision(6) << std::setw(18) << "2 MB pages" << ' ' << std::setw(7) << static_cast<double>(huge_pages_ns.count()) * 1e-3
+		<< " us, " << (have_tlb_misses ? std::to_string(huge_pages_tlb) : "n/a") << std::endl;
+	std::cout << std::endl << "Single-threaded software prefetch distance (L2 misses per 1000 px):" << std::endl;
+	for (size_t i = 0; i < prefetch_ns.size(); ++i) {
+		std::cout << std::left << std::setprecision(4) << "dist " << std::setw(5) << prefetch_dists[i] << ' ' << std::setw(7) << static_cast<double>(prefetch_ns[i].count()) * 1e-3
+			<< " us, " << (have_l2_misses ? std::to_string(prefetch_l2[i]) : "n/a") << std::endl;
+	}
+	std::cout << std::endl << "4096-wide image by stride, as is vs. KFASTRepitch::Auto:" << std::endl;
+	for (size_t i = 0; i < alias_ns.size(); ++i) {
+		std::cout << std::left << std::setprecision(6) << "stride " << std::setw(5) << alias_strides[i] << ' ' << std::setw(7) << static_cast<double>(alias_ns[i].count()) * 1e-3
+			<< " us vs. " << static_cast<double>(repitch_ns[i].count()) * 1e-3 << " us" << std::endl;
+	}
+	std::cout << std::endl << "Cycles/pixel, full-width rows vs. " << tile_cols << "-column strips:" << std::endl;
+	{
+		size_t i = 0;
+		for (const int width : tile_widths) {
+			std::cout << std::left << std::setprecision(4) << "width " << std::setw(6) << width << ' ' << std::setw(7) << full_cpp[i] << " vs. " << tiled_cpp[i] << std::endl;
+			++i;
+		}
+	}
 	std::cout << std::endl;
 	if (display_image) {
 		std::vector<cv::KeyPoint> converted_kps;